@@ -36,6 +36,8 @@
 
 #include "call-content.h"
 #include "call-priv.h"
+#include "conference-pool.h"
+#include "utils.h"
 
 
 static void call_channel_async_initable_init (GAsyncInitableIface *asynciface);
@@ -169,13 +171,38 @@ free_participant (gpointer data)
   g_slice_free (struct CallParticipant, cp);
 }
 
+static guint
+participant_hash (gconstpointer key)
+{
+  const struct CallParticipant *cp = key;
+
+  return g_direct_hash (cp->fsconference) ^ cp->handle;
+}
+
+static gboolean
+participant_equal (gconstpointer a, gconstpointer b)
+{
+  const struct CallParticipant *cp1 = a;
+  const struct CallParticipant *cp2 = b;
+
+  return cp1->fsconference == cp2->fsconference && cp1->handle == cp2->handle;
+}
+
 static void
 tf_call_channel_init (TfCallChannel *self)
 {
   self->fsconferences = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
       free_call_conference);
+  self->fsconferences_by_conference = g_hash_table_new (g_direct_hash,
+      g_direct_equal);
+
+  self->participants = g_hash_table_new_full (participant_hash,
+      participant_equal, free_participant, NULL);
+  self->participants_by_fsparticipant = g_hash_table_new (g_direct_hash,
+      g_direct_equal);
 
-  self->participants = g_ptr_array_new_with_free_func (free_participant);
+  self->bus_routes = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, (GDestroyNotify) g_slist_free);
 }
 
 
@@ -188,6 +215,7 @@ tf_call_channel_init_async (GAsyncInitable *initable,
 {
   TfCallChannel *self = TF_CALL_CHANNEL (initable);
   GSimpleAsyncResult *res;
+  gboolean pushed;
 
   if (cancellable != NULL)
     {
@@ -197,6 +225,8 @@ tf_call_channel_init_async (GAsyncInitable *initable,
       return;
     }
 
+  pushed = push_thread_default_context (self->context);
+
   res = g_simple_async_result_new (G_OBJECT (self), callback, user_data,
       tf_call_channel_init_async);
 
@@ -206,6 +236,8 @@ tf_call_channel_init_async (GAsyncInitable *initable,
       G_CALLBACK (content_removed), self, 0);
 
   tp_proxy_prepare_async (self->proxy, NULL, channel_prepared, res);
+
+  pop_thread_default_context (self->context, pushed);
 }
 
 static gboolean
@@ -250,10 +282,22 @@ tf_call_channel_dispose (GObject *object)
     }
   self->contents = NULL;
 
+  if (self->participants_by_fsparticipant)
+    g_hash_table_unref (self->participants_by_fsparticipant);
+  self->participants_by_fsparticipant = NULL;
+
   if (self->participants)
-    g_ptr_array_unref (self->participants);
+    g_hash_table_unref (self->participants);
   self->participants = NULL;
 
+  if (self->bus_routes)
+    g_hash_table_unref (self->bus_routes);
+  self->bus_routes = NULL;
+
+  if (self->fsconferences_by_conference)
+    g_hash_table_unref (self->fsconferences_by_conference);
+  self->fsconferences_by_conference = NULL;
+
   if (self->fsconferences)
       g_hash_table_unref (self->fsconferences);
   self->fsconferences = NULL;
@@ -262,6 +306,10 @@ tf_call_channel_dispose (GObject *object)
     g_object_unref (self->proxy);
   self->proxy = NULL;
 
+  if (self->context)
+    g_main_context_unref (self->context);
+  self->context = NULL;
+
   if (G_OBJECT_CLASS (tf_call_channel_parent_class)->dispose)
     G_OBJECT_CLASS (tf_call_channel_parent_class)->dispose (object);
 }
@@ -324,6 +372,7 @@ add_content (TfCallChannel *self, TpCallContent *content_proxy)
 {
   GError *error = NULL;
   TfCallContent *content;
+  gboolean pushed;
   guint i;
 
   /* Check if content already added */
@@ -337,8 +386,10 @@ add_content (TfCallChannel *self, TpCallContent *content_proxy)
         return TRUE;
     }
 
+  pushed = push_thread_default_context (self->context);
   content = tf_call_content_new_async (self, content_proxy,
       &error, content_ready, g_object_ref (self));
+  pop_thread_default_context (self->context, pushed);
 
   if (error)
     {
@@ -447,14 +498,25 @@ out:
   g_object_unref (self);
 }
 
+/* The options are the construct-only properties of @tfchannel, they are
+ * copied as they never change */
 void
 tf_call_channel_new_async (TpChannel *channel,
+    TfChannel *tfchannel,
     GAsyncReadyCallback callback,
     gpointer user_data)
 {
   TfCallChannel *self = g_object_new (TF_TYPE_CALL_CHANNEL, NULL);
 
   self->proxy = g_object_ref (channel);
+  g_object_get (tfchannel,
+      "main-context", &self->context,
+      "speculative-sessions", &self->speculative_sessions,
+      "early-media", &self->early_media,
+      "candidate-batch-delay", &self->candidate_batch_delay,
+      "pre-gather-candidates", &self->pre_gather_candidates,
+      "shared-media-description", &self->shared_media_description,
+      NULL);
   g_async_initable_init_async (G_ASYNC_INITABLE (self), 0, NULL, callback,
       user_data);
 
@@ -463,26 +525,37 @@ tf_call_channel_new_async (TpChannel *channel,
 }
 
 
-static gboolean
-find_conf_func (gpointer key, gpointer value, gpointer data)
-{
-  FsConference *conf = data;
-  struct CallConference *cc = value;
-
-  if (cc->fsconference == conf)
-    return TRUE;
-  else
-    return FALSE;
-}
-
 static struct CallConference *
 find_call_conference_by_conference (TfCallChannel *channel,
     GstObject *conference)
 {
-  return g_hash_table_find (channel->fsconferences, find_conf_func,
+  return g_hash_table_lookup (channel->fsconferences_by_conference,
       conference);
 }
 
+/* Farstream element messages carry the object they are about in one of
+ * these fields, this is what the routes are keyed on */
+static gpointer
+get_message_fsobject (GstMessage *message)
+{
+  const GstStructure *s = gst_message_get_structure (message);
+  const GValue *value;
+
+  if (s == NULL)
+    return NULL;
+
+  value = gst_structure_get_value (s, "stream");
+  if (value == NULL)
+    value = gst_structure_get_value (s, "session");
+  if (value == NULL)
+    value = gst_structure_get_value (s, "src-object");
+
+  if (value == NULL || !G_VALUE_HOLDS_OBJECT (value))
+    return NULL;
+
+  return g_value_get_object (value);
+}
+
 gboolean
 tf_call_channel_bus_message (TfCallChannel *channel,
     GstMessage *message)
@@ -490,7 +563,9 @@ tf_call_channel_bus_message (TfCallChannel *channel,
   GError *error = NULL;
   gchar *debug;
   struct CallConference *cc;
-  guint i;
+  gpointer fsobject;
+  GSList *targets;
+  GObject *target;
 
   cc = find_call_conference_by_conference (channel, GST_MESSAGE_SRC (message));
   if (!cc)
@@ -516,14 +591,25 @@ tf_call_channel_bus_message (TfCallChannel *channel,
       g_error_free (error);
       g_free (debug);
       return TRUE;
-    default:
+    case GST_MESSAGE_ELEMENT:
       break;
+    default:
+      return FALSE;
     }
 
-  for (i = 0; i < channel->contents->len; i++)
-    if (tf_call_content_bus_message (g_ptr_array_index (channel->contents, i),
-            message))
-      return TRUE;
+  fsobject = get_message_fsobject (message);
+  if (fsobject == NULL)
+    return FALSE;
+
+  targets = g_hash_table_lookup (channel->bus_routes, fsobject);
+  if (targets == NULL)
+    return FALSE;
+  target = targets->data;
+
+  if (TF_IS_CALL_CONTENT (target))
+    return tf_call_content_bus_message (TF_CALL_CONTENT (target), message);
+  else if (TF_IS_CALL_STREAM (target))
+    return tf_call_stream_bus_message (TF_CALL_STREAM (target), message);
 
   return FALSE;
 }
@@ -542,7 +628,6 @@ FsConference *
 _tf_call_channel_get_conference (TfCallChannel *channel,
     const gchar *conference_type)
 {
-  gchar *tmp;
   struct CallConference *cc;
 
   cc = g_hash_table_lookup (channel->fsconferences, conference_type);
@@ -558,19 +643,19 @@ _tf_call_channel_get_conference (TfCallChannel *channel,
   cc->use_count = 1;
   cc->conference_type = g_strdup (conference_type);
 
-  tmp = g_strdup_printf ("fs%sconference", conference_type);
-  cc->fsconference = FS_CONFERENCE (gst_element_factory_make (tmp, NULL));
-  g_free (tmp);
+  /* We get our own reference to the conference */
+  cc->fsconference = _tf_conference_pool_get (conference_type);
 
   if (cc->fsconference == NULL)
   {
+    g_free (cc->conference_type);
     g_slice_free (struct CallConference, cc);
     return NULL;
   }
 
-  /* Take ownership of the conference */
-  gst_object_ref_sink (cc->fsconference);
   g_hash_table_insert (channel->fsconferences, cc->conference_type, cc);
+  g_hash_table_insert (channel->fsconferences_by_conference,
+      cc->fsconference, cc);
 
   g_signal_emit (channel, signals[SIGNAL_FS_CONFERENCE_ADDED], 0,
       cc->fsconference);
@@ -600,6 +685,8 @@ _tf_call_channel_put_conference (TfCallChannel *channel,
     {
       g_signal_emit (channel, signals[SIGNAL_FS_CONFERENCE_REMOVED], 0,
           cc->fsconference);
+      g_hash_table_remove (channel->fsconferences_by_conference,
+          cc->fsconference);
       g_hash_table_remove (channel->fsconferences, cc->conference_type);
       g_object_notify (G_OBJECT (channel), "fs-conferences");
     }
@@ -614,20 +701,15 @@ _tf_call_channel_get_participant (TfCallChannel *channel,
     guint contact_handle,
     GError **error)
 {
-  guint i;
+  struct CallParticipant key = { 0, contact_handle, fsconference, NULL };
   struct CallParticipant *cp;
   FsParticipant *p;
 
-  for (i = 0; i < channel->participants->len; i++)
+  cp = g_hash_table_lookup (channel->participants, &key);
+  if (cp)
     {
-      cp = g_ptr_array_index (channel->participants, i);
-
-      if (cp->fsconference == fsconference &&
-          cp->handle == contact_handle)
-        {
-          cp->use_count++;
-          return g_object_ref (cp->fsparticipant);
-        }
+      cp->use_count++;
+      return g_object_ref (cp->fsparticipant);
     }
 
   p = fs_conference_new_participant (fsconference, error);
@@ -639,7 +721,8 @@ _tf_call_channel_get_participant (TfCallChannel *channel,
   cp->handle = contact_handle;
   cp->fsconference = gst_object_ref (fsconference);
   cp->fsparticipant = p;
-  g_ptr_array_add (channel->participants, cp);
+  g_hash_table_insert (channel->participants, cp, cp);
+  g_hash_table_insert (channel->participants_by_fsparticipant, p, cp);
 
   return p;
 }
@@ -649,20 +732,67 @@ void
 _tf_call_channel_put_participant (TfCallChannel *channel,
     FsParticipant *participant)
 {
-  guint i;
+  struct CallParticipant *cp;
 
-   for (i = 0; i < channel->participants->len; i++)
-    {
-      struct CallParticipant *cp = g_ptr_array_index (channel->participants, i);
+  cp = g_hash_table_lookup (channel->participants_by_fsparticipant,
+      participant);
+  if (cp == NULL)
+    return;
 
-      if (cp->fsparticipant == participant)
-        {
-          cp->use_count--;
-          if (cp->use_count <= 0)
-            g_ptr_array_remove_index_fast (channel->participants, i);
-          else
-            gst_object_unref (cp->fsparticipant);
-          return;
-        }
+  cp->use_count--;
+  if (cp->use_count <= 0)
+    {
+      g_hash_table_remove (channel->participants_by_fsparticipant,
+          participant);
+      g_hash_table_remove (channel->participants, cp);
     }
+  else
+    {
+      gst_object_unref (cp->fsparticipant);
+    }
+}
+
+
+/* Routes let tf_call_channel_bus_message() go straight from the FsSession or
+ * FsStream a message is about to the object handling it. An FsStream can be
+ * shared by several TfCallStreams, so every target is kept and messages go to
+ * the oldest one still registered.
+ */
+void
+_tf_call_channel_add_bus_route (TfCallChannel *channel,
+    gpointer fsobject,
+    GObject *target)
+{
+  GSList *targets;
+
+  if (channel->bus_routes == NULL)
+    return;
+
+  targets = g_hash_table_lookup (channel->bus_routes, fsobject);
+  if (g_slist_find (targets, target))
+    return;
+
+  g_hash_table_steal (channel->bus_routes, fsobject);
+  targets = g_slist_append (targets, target);
+  g_hash_table_insert (channel->bus_routes, fsobject, targets);
+}
+
+void
+_tf_call_channel_remove_bus_route (TfCallChannel *channel,
+    gpointer fsobject,
+    GObject *target)
+{
+  GSList *targets;
+
+  if (channel->bus_routes == NULL)
+    return;
+
+  targets = g_hash_table_lookup (channel->bus_routes, fsobject);
+  if (!g_slist_find (targets, target))
+    return;
+
+  g_hash_table_steal (channel->bus_routes, fsobject);
+  targets = g_slist_remove (targets, target);
+  if (targets)
+    g_hash_table_insert (channel->bus_routes, fsobject, targets);
 }
@@ -26,6 +26,8 @@
 #include <farstream/fs-conference.h>
 #include <telepathy-glib/telepathy-glib.h>
 
+#include "channel.h"
+
 G_BEGIN_DECLS
 
 #define TF_TYPE_CALL_CHANNEL tf_call_channel_get_type()
@@ -74,11 +76,26 @@ struct _TfCallChannel {
 
   TpChannel *proxy;
 
+  GMainContext *context;
+  gboolean speculative_sessions;
+  gboolean early_media;
+  guint candidate_batch_delay;
+  gboolean pre_gather_candidates;
+  gboolean shared_media_description;
+
   GHashTable *fsconferences;
+  /* FsConference -> CallConference, owned by fsconferences */
+  GHashTable *fsconferences_by_conference;
 
   GPtrArray *contents; /* NULL before getting the first contents */
 
-  GPtrArray *participants;
+  /* (FsConference, handle) -> CallParticipant, owns them */
+  GHashTable *participants;
+  /* FsParticipant -> CallParticipant */
+  GHashTable *participants_by_fsparticipant;
+
+  /* FsSession/FsStream -> GSList of TfCallContent/TfCallStream, not reffed */
+  GHashTable *bus_routes;
 };
 
 struct _TfCallChannelClass{
@@ -89,6 +106,7 @@ struct _TfCallChannelClass{
 GType tf_call_channel_get_type (void);
 
 void tf_call_channel_new_async (TpChannel *channel_proxy,
+    TfChannel *tfchannel,
     GAsyncReadyCallback callback,
     gpointer user_data);
 
@@ -112,6 +130,13 @@ FsParticipant *_tf_call_channel_get_participant (TfCallChannel *channel,
 void _tf_call_channel_put_participant (TfCallChannel *channel,
     FsParticipant *participant);
 
+void _tf_call_channel_add_bus_route (TfCallChannel *channel,
+    gpointer fsobject,
+    GObject *target);
+void _tf_call_channel_remove_bus_route (TfCallChannel *channel,
+    gpointer fsobject,
+    GObject *target);
+
 G_END_DECLS
 
 #endif /* __TF_CALL_CHANNEL_H__ */
@@ -55,6 +55,8 @@
 
 #include "call-stream.h"
 #include "call-priv.h"
+#include "codec-cache.h"
+#include "debug.h"
 #include "utils.h"
 
 #define DTMF_TONE_VOLUME (8)
@@ -64,6 +66,7 @@ struct _TfCallContent {
 
   TfCallChannel *call_channel;
   FsConference *fsconference;
+  const gchar *conference_type;
 
   TpCallContent *proxy;
 
@@ -80,12 +83,30 @@ struct _TfCallContent {
   gboolean has_rtcp_fb;
 
   GList *last_sent_codecs;
+  guint last_sent_fingerprint;
+  /* Contact handles that were given last_sent_codecs, protected by the
+   * Mutex */
+  GHashTable *last_sent_handles;
+
+  /* Last media description sent and what it was built with, it can be
+   * sent again as is if the codecs did not change */
+  GHashTable *last_media_description;
+  gboolean last_md_rtp_hdrext;
+  gboolean last_md_rtcp_fb;
+
+  /* Set once the CM refused a media description for all contacts as not
+   * implemented or invalid */
+  gboolean no_shared_media_description;
+
+  /* Pending coalesced local codecs update */
+  GSource *codecs_changed_source;
+  guint codec_update_delay;
 
   GPtrArray *streams; /* NULL before getting the first streams */
   /* Streams for which we don't have a session yet*/
   GList *outstanding_streams;
 
-  GMutex *mutex;
+  GMutex mutex;
 
   gboolean remote_codecs_set;
 
@@ -94,7 +115,15 @@ struct _TfCallContent {
 
   /* Content protected by the Mutex */
   GPtrArray *fsstreams;
-  guint fsstreams_cookie;
+  GHashTable *fsstreams_by_handle; /* contact handle -> CallFsStream */
+  GHashTable *fsstreams_by_fsstream; /* FsStream -> CallFsStream */
+
+  /* Read-only copy of the fsstreams for the streaming threads, rebuilt by
+   * the main thread on every change and swapped as a whole, the snapshot
+   * mutex only protects the pointer so readers never wait for the content
+   * mutex */
+  GMutex snapshot_mutex;
+  struct FsStreamsSnapshot *fsstreams_snapshot;
 
   gboolean got_media_description_property;
 
@@ -127,8 +156,8 @@ G_DEFINE_TYPE_WITH_CODE (TfCallContent, tf_call_content, TF_TYPE_CONTENT,
                          G_IMPLEMENT_INTERFACE (G_TYPE_ASYNC_INITABLE,
                              call_content_async_initable_init))
 
-#define TF_CALL_CONTENT_LOCK(self)   g_mutex_lock ((self)->mutex)
-#define TF_CALL_CONTENT_UNLOCK(self) g_mutex_unlock ((self)->mutex)
+#define TF_CALL_CONTENT_LOCK(self)   g_mutex_lock (&(self)->mutex)
+#define TF_CALL_CONTENT_UNLOCK(self) g_mutex_unlock (&(self)->mutex)
 
 
 enum
@@ -145,7 +174,8 @@ enum
   PROP_REPORTED_OUTPUT_VOLUME,
   PROP_FRAMERATE,
   PROP_WIDTH,
-  PROP_HEIGHT
+  PROP_HEIGHT,
+  PROP_CODEC_UPDATE_DELAY
 };
 
 enum
@@ -165,6 +195,13 @@ struct CallFsStream {
   FsStream *fsstream;
 };
 
+struct FsStreamsSnapshot {
+  volatile gint refcount;
+  guint32 cookie; /* Never changes, for GstIterator */
+  GHashTable *by_handle; /* contact handle -> FsStream, reffed */
+  GHashTable *by_fsstream; /* FsStream -> contact handle */
+};
+
 static void
 tf_call_content_get_property (GObject    *object,
     guint       property_id,
@@ -298,6 +335,25 @@ tf_call_content_class_init (TfCallContentClass *klass)
       0, G_MAXUINT, 0,
       G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * TfCallContent:codec-update-delay:
+   *
+   * How long, in milliseconds, to wait for more local codec changes after
+   * one before giving the updated local media description to the
+   * connection manager, so that a burst of changes results in a single
+   * update. The default, 0, sends it on the next main loop iteration.
+   *
+   * Since: 0.6.3
+   */
+
+  g_object_class_install_property (object_class, PROP_CODEC_UPDATE_DELAY,
+    g_param_spec_uint ("codec-update-delay",
+      "Codec update delay",
+      "How long to wait in ms for more codec changes before sending the"
+      " local media description, 0 means the next main loop iteration",
+      0, G_MAXUINT, 0,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   signals[RESOLUTION_CHANGED] = g_signal_new ("resolution-changed",
       G_OBJECT_CLASS_TYPE (klass),
       G_SIGNAL_RUN_LAST,
@@ -313,6 +369,80 @@ call_content_async_initable_init (GAsyncInitableIface *asynciface)
 }
 
 
+static void
+fsstreams_snapshot_unref (struct FsStreamsSnapshot *snapshot)
+{
+  if (!g_atomic_int_dec_and_test (&snapshot->refcount))
+    return;
+
+  g_hash_table_unref (snapshot->by_fsstream);
+  g_hash_table_unref (snapshot->by_handle);
+  g_slice_free (struct FsStreamsSnapshot, snapshot);
+}
+
+static struct FsStreamsSnapshot *
+fsstreams_snapshot_new (void)
+{
+  struct FsStreamsSnapshot *snapshot = g_slice_new (struct FsStreamsSnapshot);
+
+  snapshot->refcount = 1;
+  snapshot->cookie = 0;
+  snapshot->by_handle = g_hash_table_new_full (g_direct_hash,
+      g_direct_equal, NULL, g_object_unref);
+  snapshot->by_fsstream = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  return snapshot;
+}
+
+/* Called with the content lock held, after each change to the fsstreams */
+static void
+tf_call_content_publish_fsstreams (TfCallContent *self)
+{
+  struct FsStreamsSnapshot *snapshot = NULL;
+  struct FsStreamsSnapshot *old;
+  guint i;
+
+  if (self->fsstreams)
+    {
+      snapshot = fsstreams_snapshot_new ();
+
+      for (i = 0; i < self->fsstreams->len; i++)
+        {
+          struct CallFsStream *cfs = g_ptr_array_index (self->fsstreams, i);
+
+          g_hash_table_insert (snapshot->by_handle,
+              GUINT_TO_POINTER (cfs->contact_handle),
+              g_object_ref (cfs->fsstream));
+          g_hash_table_insert (snapshot->by_fsstream, cfs->fsstream,
+              GUINT_TO_POINTER (cfs->contact_handle));
+        }
+    }
+
+  g_mutex_lock (&self->snapshot_mutex);
+  old = self->fsstreams_snapshot;
+  self->fsstreams_snapshot = snapshot;
+  g_mutex_unlock (&self->snapshot_mutex);
+
+  if (old)
+    fsstreams_snapshot_unref (old);
+}
+
+static struct FsStreamsSnapshot *
+tf_call_content_get_fsstreams_snapshot (TfCallContent *self)
+{
+  struct FsStreamsSnapshot *snapshot;
+
+  /* Never take the content lock here, streaming threads call this while the
+   * main thread may hold it for a long time */
+  g_mutex_lock (&self->snapshot_mutex);
+  snapshot = self->fsstreams_snapshot;
+  if (snapshot)
+    g_atomic_int_inc (&snapshot->refcount);
+  g_mutex_unlock (&self->snapshot_mutex);
+
+  return snapshot;
+}
+
 static void
 free_content_fsstream (gpointer data)
 {
@@ -328,9 +458,14 @@ static void
 tf_call_content_init (TfCallContent *self)
 {
   self->fsstreams = g_ptr_array_new ();
+  self->fsstreams_by_handle = g_hash_table_new (g_direct_hash, g_direct_equal);
+  self->fsstreams_by_fsstream = g_hash_table_new (g_direct_hash,
+      g_direct_equal);
+  self->last_sent_handles = g_hash_table_new (g_direct_hash, g_direct_equal);
+  g_mutex_init (&self->snapshot_mutex);
   self->dtmf_sending_state = TP_SENDING_STATE_NONE;
 
-  self->mutex = g_mutex_new ();
+  g_mutex_init (&self->mutex);
   self->requested_input_volume = -1;
   self->requested_output_volume = -1;
 
@@ -341,6 +476,13 @@ tf_call_content_init (TfCallContent *self)
 void
 _tf_call_content_destroy (TfCallContent *self)
 {
+  if (self->codecs_changed_source)
+    {
+      g_source_destroy (self->codecs_changed_source);
+      g_source_unref (self->codecs_changed_source);
+    }
+  self->codecs_changed_source = NULL;
+
   if (self->streams)
     {
       g_ptr_array_free (self->streams, TRUE);
@@ -349,6 +491,9 @@ _tf_call_content_destroy (TfCallContent *self)
 
   if (self->fssession)
     {
+      if (self->call_channel)
+        _tf_call_channel_remove_bus_route (self->call_channel,
+            self->fssession, G_OBJECT (self));
       fs_session_destroy (self->fssession);
       g_object_unref (self->fssession);
     }
@@ -356,12 +501,27 @@ _tf_call_content_destroy (TfCallContent *self)
 
   if (self->fsstreams)
     {
-      while (self->fsstreams->len)
+      GPtrArray *fsstreams;
+
+      TF_CALL_CONTENT_LOCK (self);
+      fsstreams = self->fsstreams;
+      self->fsstreams = NULL;
+      tf_call_content_publish_fsstreams (self);
+      TF_CALL_CONTENT_UNLOCK (self);
+
+      while (fsstreams->len)
         free_content_fsstream (
-            g_ptr_array_remove_index_fast (self->fsstreams, 0));
-      g_ptr_array_unref (self->fsstreams);
+            g_ptr_array_remove_index_fast (fsstreams, 0));
+      g_ptr_array_unref (fsstreams);
   }
-  self->fsstreams = NULL;
+
+  if (self->fsstreams_by_handle)
+    g_hash_table_unref (self->fsstreams_by_handle);
+  self->fsstreams_by_handle = NULL;
+
+  if (self->fsstreams_by_fsstream)
+    g_hash_table_unref (self->fsstreams_by_fsstream);
+  self->fsstreams_by_fsstream = NULL;
 
   if (self->notifier)
     g_object_unref (self->notifier);
@@ -402,8 +562,19 @@ tf_call_content_finalize (GObject *object)
 
   fs_codec_list_destroy (self->last_sent_codecs);
   self->last_sent_codecs = NULL;
+  g_hash_table_unref (self->last_sent_handles);
 
-  g_mutex_free (self->mutex);
+  if (self->last_media_description)
+    g_boxed_free (TP_HASH_TYPE_MEDIA_DESCRIPTION_PROPERTIES,
+        self->last_media_description);
+  self->last_media_description = NULL;
+
+  if (self->fsstreams_snapshot)
+    fsstreams_snapshot_unref (self->fsstreams_snapshot);
+  self->fsstreams_snapshot = NULL;
+
+  g_mutex_clear (&self->mutex);
+  g_mutex_clear (&self->snapshot_mutex);
 
   if (G_OBJECT_CLASS (tf_call_content_parent_class)->finalize)
     G_OBJECT_CLASS (tf_call_content_parent_class)->finalize (object);
@@ -463,6 +634,9 @@ tf_call_content_get_property (GObject    *object,
     case PROP_HEIGHT:
       g_value_set_uint (value, self->height);
       break;
+    case PROP_CODEC_UPDATE_DELAY:
+      g_value_set_uint (value, self->codec_update_delay);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -500,6 +674,9 @@ tf_call_content_set_property (GObject    *object,
           self->proxy, -1, self->reported_output_volume,
           NULL, NULL, NULL, NULL);
       break;
+    case PROP_CODEC_UPDATE_DELAY:
+      self->codec_update_delay = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -596,9 +773,12 @@ tpcodecs_to_fscodecs (FsMediaType fsmediatype, const GPtrArray *tpcodecs,
             }
         }
 
-      tmp = fs_codec_to_string (fscodec);
-      g_debug ("%s", tmp);
-      g_free (tmp);
+      if (TF_DEBUG_ON (CODECS))
+        {
+          tmp = fs_codec_to_string (fscodec);
+          g_debug ("%s", tmp);
+          g_free (tmp);
+        }
       fscodecs = g_list_prepend (fscodecs, fscodec);
     }
 
@@ -630,7 +810,7 @@ tprtphdrext_to_fsrtphdrext (GPtrArray *rtp_hdrext)
       ext = fs_rtp_header_extension_new (id,
           tpdirection_to_fsdirection (direction), uri);
 
-      g_debug ("hdrext: " FS_RTP_HEADER_EXTENSION_FORMAT,
+      TF_DEBUG (CODECS, "hdrext: " FS_RTP_HEADER_EXTENSION_FORMAT,
           FS_RTP_HEADER_EXTENSION_ARGS (ext));
 
       g_queue_push_tail (&ret, ext);
@@ -750,10 +930,20 @@ process_media_description_try_codecs (TfCallContent *self, FsStream *fsstream,
 
       if (success)
         {
+          guint i;
+
           if (!self->remote_codecs_set)
             on_content_dtmf_change_requested (NULL, self->current_dtmf_event,
                 self->dtmf_sending_state, NULL, G_OBJECT (self));
           self->remote_codecs_set = TRUE;
+
+          for (i = 0; self->streams && i < self->streams->len; i++)
+            {
+              TfCallStream *stream = g_ptr_array_index (self->streams, i);
+
+              if (stream->fsstream == fsstream)
+                _tf_call_stream_try_early_media (stream);
+            }
         }
 
       if (!success &&
@@ -781,7 +971,7 @@ process_media_description_try_codecs (TfCallContent *self, FsStream *fsstream,
           "Remote codecs are not compatible with the local ones",
           G_TYPE_INVALID);
 
-      g_debug ("Rejecting Media Description");
+      TF_DEBUG (CONTENT, "Rejecting Media Description");
       tp_cli_call_content_media_description_call_reject (media_description,
           -1, reason, NULL, NULL, NULL, NULL);
       g_value_array_free (reason);
@@ -887,7 +1077,7 @@ process_media_description (TfCallContent *self,
     }
 
 
-  g_debug ("Got MediaDescription %s", media_description_objpath);
+  TF_DEBUG (CONTENT, "Got MediaDescription %s", media_description_objpath);
   fscodecs = tpcodecs_to_fscodecs (tf_call_content_get_fs_media_type (self),
       codecs, does_avpf, rtcp_fb);
 
@@ -899,7 +1089,7 @@ process_media_description (TfCallContent *self,
 
   if (!fsstream)
     {
-      g_debug ("Delaying codec media_description processing");
+      TF_DEBUG (CONTENT, "Delaying codec media_description processing");
       self->current_media_description = proxy;
       self->current_md_fscodecs = fscodecs;
       self->current_md_rtp_hdrext = fsrtp_hdrext;
@@ -1076,6 +1266,71 @@ streams_removed (TpCallContent *proxy,
         }
 }
 
+static gboolean
+tf_call_content_create_session (TfCallContent *self,
+    const gchar *conference_type, GError **error)
+{
+  GList *codec_prefs;
+  GError *myerror = NULL;
+
+  self->fsconference = _tf_call_channel_get_conference (self->call_channel,
+      conference_type);
+  if (!self->fsconference)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+          "Could not create FsConference for type %s", conference_type);
+      return FALSE;
+    }
+  self->conference_type = conference_type;
+
+  self->fssession = fs_conference_new_session (self->fsconference,
+      tf_call_content_get_fs_media_type (self), error);
+
+  if (!self->fssession)
+    {
+      g_prefix_error (error, "Could not create FsSession: ");
+      _tf_call_channel_put_conference (self->call_channel,
+          self->fsconference);
+      self->fsconference = NULL;
+      self->conference_type = NULL;
+      return FALSE;
+    }
+
+  _tf_call_channel_add_bus_route (self->call_channel, self->fssession,
+      G_OBJECT (self));
+
+  codec_prefs = fs_utils_get_default_codec_preferences (
+      GST_ELEMENT (self->fsconference));
+
+  if (codec_prefs)
+    {
+      if (!fs_session_set_codec_preferences (self->fssession, codec_prefs,
+              &myerror))
+        {
+          g_warning ("Could not set codec preference: %s", myerror->message);
+          g_clear_error (&myerror);
+        }
+    }
+
+  return TRUE;
+}
+
+/* Drops a session created before knowing the packetization if it was not of
+ * the right type, nothing can be using it yet */
+static void
+tf_call_content_drop_session (TfCallContent *self)
+{
+  _tf_call_channel_remove_bus_route (self->call_channel, self->fssession,
+      G_OBJECT (self));
+  fs_session_destroy (self->fssession);
+  g_object_unref (self->fssession);
+  self->fssession = NULL;
+
+  _tf_call_channel_put_conference (self->call_channel, self->fsconference);
+  self->fsconference = NULL;
+  self->conference_type = NULL;
+}
+
 static void
 got_content_media_properties (TpProxy *proxy, GHashTable *properties,
     const GError *error, gpointer user_data, GObject *weak_object)
@@ -1089,7 +1344,6 @@ got_content_media_properties (TpProxy *proxy, GHashTable *properties,
   guint32 packetization;
   const gchar *conference_type;
   gboolean valid;
-  GList *codec_prefs;
   guchar dtmf_event;
   guint dtmf_state;
   const GValue *dtmf_event_value;
@@ -1115,8 +1369,6 @@ got_content_media_properties (TpProxy *proxy, GHashTable *properties,
   if (!valid)
     goto invalid_property;
 
-  g_assert (self->fssession == NULL);
-
   switch (packetization)
     {
       case TP_CALL_CONTENT_PACKETIZATION_TYPE_RTP:
@@ -1137,30 +1389,18 @@ got_content_media_properties (TpProxy *proxy, GHashTable *properties,
         return;
     }
 
-  self->fsconference = _tf_call_channel_get_conference (self->call_channel,
-      conference_type);
-  if (!self->fsconference)
-    {
-      tf_call_content_error (self,
-          TP_CALL_STATE_CHANGE_REASON_MEDIA_ERROR,
-          TP_ERROR_STR_MEDIA_UNSUPPORTED_TYPE,
-          "Could not create FsConference for type %s", conference_type);
-      g_simple_async_result_set_error (res, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
-          "Error getting the Content's properties: invalid type");
-      g_simple_async_result_complete (res);
-      g_object_unref (res);
-      return;
-    }
+  /* The session may already have been created speculatively */
+  if (self->fssession != NULL &&
+      strcmp (self->conference_type, conference_type))
+    tf_call_content_drop_session (self);
 
-  self->fssession = fs_conference_new_session (self->fsconference,
-      tf_call_content_get_fs_media_type (self), &myerror);
-
-  if (!self->fssession)
+  if (self->fssession == NULL &&
+      !tf_call_content_create_session (self, conference_type, &myerror))
     {
       tf_call_content_error (self,
           TP_CALL_STATE_CHANGE_REASON_MEDIA_ERROR,
           TP_ERROR_STR_MEDIA_UNSUPPORTED_TYPE,
-          "Could not create FsSession: %s", myerror != NULL ? myerror->message : "(unknown error)");
+          "%s", myerror != NULL ? myerror->message : "(unknown error)");
       g_simple_async_result_set_from_error (res, myerror);
       g_simple_async_result_complete (res);
       g_clear_error (&myerror);
@@ -1183,19 +1423,6 @@ got_content_media_properties (TpProxy *proxy, GHashTable *properties,
       goto invalid_property;
     }
 
-  codec_prefs = fs_utils_get_default_codec_preferences (
-      GST_ELEMENT (self->fsconference));
-
-  if (codec_prefs)
-    {
-      if (!fs_session_set_codec_preferences (self->fssession, codec_prefs,
-              &myerror))
-        {
-          g_warning ("Could not set codec preference: %s", myerror->message);
-          g_clear_error (&myerror);
-        }
-    }
-
   /* First complete so we get signalled and the preferences can be set, then
    * start looking at the media_description. We only unref the result later, to avoid
    * self possibly being disposed early */
@@ -1680,6 +1907,16 @@ content_prepared (GObject *src, GAsyncResult *prepare_res,
       return;
     }
 
+  /* Start discovering the local codecs while we fetch the rest of the
+   * properties, almost every content is RTP */
+  if (self->call_channel->speculative_sessions &&
+      !tf_call_content_create_session (self, "rtp", &error))
+    {
+      TF_DEBUG (CONTENT, "Could not create a speculative session: %s",
+          error->message);
+      g_clear_error (&error);
+    }
+
   if (tp_proxy_has_interface_by_id (proxy,
           TP_IFACE_QUARK_CALL_CONTENT_INTERFACE_AUDIO_CONTROL))
     setup_content_audio_control (self, res);
@@ -1756,16 +1993,59 @@ tf_call_content_new_async (TfCallChannel *call_channel,
   return self;
 }
 
+/* Consistent with fs_codec_are_equal(), the parameters are combined in an
+ * order independent way as that function ignores their order */
+static guint
+fscodec_hash (gconstpointer key)
+{
+  const FsCodec *fscodec = key;
+  GList *item;
+  guint hash = fscodec->id;
+  guint params_hash = 0;
+  gchar *tmp;
+
+  if (fscodec->encoding_name)
+    {
+      tmp = g_ascii_strdown (fscodec->encoding_name, -1);
+      hash = hash * 31 + g_str_hash (tmp);
+      g_free (tmp);
+    }
+  hash = hash * 31 + fscodec->clock_rate;
+  hash = hash * 31 + fscodec->channels;
+
+  for (item = fscodec->optional_params; item; item = item->next)
+    {
+      FsCodecParameter *param = item->data;
+
+      tmp = g_ascii_strdown (param->name, -1);
+      params_hash += g_str_hash (tmp) * 31 + g_str_hash (param->value);
+      g_free (tmp);
+    }
+
+  return hash * 31 + params_hash;
+}
+
 static gboolean
-find_codec (GList *codecs, FsCodec *codec)
+fscodec_equal (gconstpointer a, gconstpointer b)
+{
+  return fs_codec_are_equal (a, b);
+}
+
+static GHashTable *
+fscodecs_set_new (GList *codecs)
 {
+  GHashTable *set;
   GList *item;
 
-  for (item = codecs; item ; item = item->next)
-    if (fs_codec_are_equal (item->data, codec))
-      return TRUE;
+  if (codecs == NULL)
+    return NULL;
 
-  return FALSE;
+  set = g_hash_table_new (fscodec_hash, fscodec_equal);
+
+  for (item = codecs; item; item = item->next)
+    g_hash_table_insert (set, item->data, item->data);
+
+  return set;
 }
 
 
@@ -1775,6 +2055,7 @@ fscodecs_to_media_descriptions (TfCallContent *self, GList *codecs)
   GPtrArray *tpcodecs = g_ptr_array_new ();
   GList *item;
   GList *resend_codecs = NULL;
+  GHashTable *resend_set;
   GHashTable *retval;
   GPtrArray *rtp_hdrext = NULL;
   GHashTable *rtcp_fb = NULL;
@@ -1787,6 +2068,8 @@ fscodecs_to_media_descriptions (TfCallContent *self, GList *codecs)
   if (!self->current_media_description && !resend_codecs)
     return NULL;
 
+  resend_set = fscodecs_set_new (resend_codecs);
+
   if ((self->current_media_description && self->current_has_rtp_hdrext)
       || self->has_rtp_hdrext)
     rtp_hdrext = dbus_g_type_specialized_construct (
@@ -1797,58 +2080,46 @@ fscodecs_to_media_descriptions (TfCallContent *self, GList *codecs)
     rtcp_fb = dbus_g_type_specialized_construct (
         TP_HASH_TYPE_RTCP_FEEDBACK_MESSAGE_MAP);
 
-  g_debug ("Local codecs:");
+  TF_DEBUG (CODECS, "Local codecs:");
 
   for (item = codecs; item; item = item->next)
     {
       FsCodec *fscodec = item->data;
-      GValue tpcodec = { 0, };
-      GHashTable *params;
-      GList *param_item;
+      GValueArray *tpcodec;
       gboolean updated;
       gchar *tmp;
 
-      tmp = fs_codec_to_string (fscodec);
-      g_debug ("%s", tmp);
-      g_free (tmp);
-
-      params = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
-
-      for (param_item = fscodec->optional_params;
-           param_item;
-           param_item = param_item->next)
+      if (TF_DEBUG_ON (CODECS))
         {
-          FsCodecParameter *param = (FsCodecParameter *) param_item->data;
-
-          g_hash_table_insert (params, g_strdup (param->name),
-                               g_strdup (param->value));
+          tmp = fs_codec_to_string (fscodec);
+          g_debug ("%s", tmp);
+          g_free (tmp);
         }
 
-      updated = find_codec (resend_codecs, fscodec);
-
-      g_value_init (&tpcodec, TP_STRUCT_TYPE_CODEC);
-      g_value_take_boxed (&tpcodec,
-          dbus_g_type_specialized_construct (TP_STRUCT_TYPE_CODEC));
-
-      dbus_g_type_struct_set (&tpcodec,
-          0, fscodec->id,
-          1, fscodec->encoding_name,
-          2, fscodec->clock_rate,
-          3, fscodec->channels,
-          4, updated,
-          5, params,
-          G_MAXUINT);
-
-
-      g_hash_table_destroy (params);
+      updated = resend_set != NULL &&
+          g_hash_table_lookup (resend_set, fscodec) != NULL;
+
+      /* The parameters are handed over to the struct instead of being
+       * copied into it */
+      tpcodec = tp_value_array_build (6,
+          G_TYPE_UINT, fscodec->id,
+          G_TYPE_STRING, fscodec->encoding_name,
+          G_TYPE_UINT, fscodec->clock_rate,
+          G_TYPE_UINT, fscodec->channels,
+          G_TYPE_BOOLEAN, updated,
+          DBUS_TYPE_G_STRING_STRING_HASHTABLE, NULL,
+          G_TYPE_INVALID);
+      g_value_take_boxed (g_value_array_get_nth (tpcodec, 5),
+          fscodec_params_to_tp (fscodec));
 
-      g_ptr_array_add (tpcodecs, g_value_get_boxed (&tpcodec));
+      g_ptr_array_add (tpcodecs, tpcodec);
 
       if (rtcp_fb != NULL &&
           (fscodec->minimum_reporting_interval != G_MAXUINT ||
            fscodec->feedback_params))
         {
           GPtrArray *messages = g_ptr_array_new ();
+          GValueArray *feedback;
           GList *item2;
 
           for (item2 = fscodec->feedback_params; item2; item2 = item2->next)
@@ -1862,18 +2133,21 @@ fscodecs_to_media_descriptions (TfCallContent *self, GList *codecs)
                       G_TYPE_INVALID));
             }
 
-          g_hash_table_insert (rtcp_fb, GUINT_TO_POINTER (fscodec->id),
-              tp_value_array_build (2,
-                  G_TYPE_UINT,
-                  fscodec->minimum_reporting_interval != G_MAXUINT ?
-                  fscodec->minimum_reporting_interval : 5000,
-                  TP_ARRAY_TYPE_RTCP_FEEDBACK_MESSAGE_LIST, messages,
-                  G_TYPE_INVALID));
+          feedback = tp_value_array_build (2,
+              G_TYPE_UINT,
+              fscodec->minimum_reporting_interval != G_MAXUINT ?
+              fscodec->minimum_reporting_interval : 5000,
+              TP_ARRAY_TYPE_RTCP_FEEDBACK_MESSAGE_LIST, NULL,
+              G_TYPE_INVALID);
+          g_value_take_boxed (g_value_array_get_nth (feedback, 1), messages);
 
-          g_boxed_free (TP_ARRAY_TYPE_RTCP_FEEDBACK_MESSAGE_LIST, messages);
+          g_hash_table_insert (rtcp_fb, GUINT_TO_POINTER (fscodec->id),
+              feedback);
         }
     }
 
+  if (resend_set != NULL)
+    g_hash_table_unref (resend_set);
   fs_codec_list_destroy (resend_codecs);
 
 
@@ -1888,7 +2162,7 @@ fscodecs_to_media_descriptions (TfCallContent *self, GList *codecs)
         {
           FsRtpHeaderExtension *hdrext = item->data;
 
-          g_debug (FS_RTP_HEADER_EXTENSION_FORMAT,
+          TF_DEBUG (CODECS, FS_RTP_HEADER_EXTENSION_FORMAT,
               FS_RTP_HEADER_EXTENSION_ARGS (hdrext));
 
           g_ptr_array_add (rtp_hdrext, tp_value_array_build (4,
@@ -1944,10 +2218,185 @@ media_description_updated_cb (TpCallContent *proxy,
   GObject *weak_object)
 {
   if (error == NULL)
-    g_debug ("Local media description set");
+    TF_DEBUG (DBUS, "Local media description set");
   else
-    g_debug ("Local media description error: %s", error->message);
+    TF_DEBUG (DBUS, "Local media description error: %s", error->message);
+
+}
+
+struct SharedMediaDescription {
+  GHashTable *media_description;
+  GArray *contact_handles;
+};
+
+static void
+shared_media_description_free (gpointer data)
+{
+  struct SharedMediaDescription *smd = data;
 
+  g_boxed_free (TP_HASH_TYPE_MEDIA_DESCRIPTION_PROPERTIES,
+      smd->media_description);
+  g_array_unref (smd->contact_handles);
+  g_slice_free (struct SharedMediaDescription, smd);
+}
+
+static void
+update_local_media_description_per_contact (TfCallContent *self,
+    GHashTable *media_description, GArray *contact_handles)
+{
+  guint i;
+
+  for (i = 0; i < contact_handles->len; i++)
+    {
+      guint handle = g_array_index (contact_handles, guint, i);
+
+      TF_DEBUG (DBUS, "Updating local Media Description for contact %u",
+          handle);
+
+      tp_asv_set_uint32 (media_description,
+          TP_PROP_CALL_CONTENT_MEDIA_DESCRIPTION_REMOTE_CONTACT, handle);
+      tp_cli_call_content_interface_media_call_update_local_media_description (
+          self->proxy, -1, media_description,
+          media_description_updated_cb, NULL, NULL, NULL);
+    }
+}
+
+static void
+shared_media_description_updated_cb (TpCallContent *proxy,
+  const GError *error,
+  gpointer user_data,
+  GObject *weak_object)
+{
+  TfCallContent *self = TF_CALL_CONTENT (weak_object);
+  struct SharedMediaDescription *smd = user_data;
+
+  if (error == NULL)
+    {
+      TF_DEBUG (DBUS, "Local media description set for all contacts");
+      return;
+    }
+
+  /* Guard against early disposal */
+  if (self->call_channel == NULL)
+    return;
+
+  g_debug ("Local media description for all contacts refused (%s),"
+      " sending one per contact", error->message);
+
+  if (g_error_matches (error, TP_ERROR, TP_ERROR_NOT_IMPLEMENTED) ||
+      g_error_matches (error, TP_ERROR, TP_ERROR_INVALID_ARGUMENT) ||
+      g_error_matches (error, TP_ERROR, TP_ERROR_INVALID_HANDLE))
+    self->no_shared_media_description = TRUE;
+
+  update_local_media_description_per_contact (self, smd->media_description,
+      smd->contact_handles);
+}
+
+/* Cheap hash of what ends up in a media description, to tell quickly that a
+ * codec list is not the one we sent last */
+static guint
+fscodecs_fingerprint (GList *codecs)
+{
+  GList *item, *item2;
+  guint hash = 0;
+
+  for (item = codecs; item; item = item->next)
+    {
+      FsCodec *fscodec = item->data;
+
+      hash = hash * 31 + fscodec->id;
+      hash = hash * 31 + g_str_hash (fscodec->encoding_name ?
+          fscodec->encoding_name : "");
+      hash = hash * 31 + fscodec->clock_rate;
+      hash = hash * 31 + fscodec->channels;
+      hash = hash * 31 + fscodec->minimum_reporting_interval;
+
+      for (item2 = fscodec->optional_params; item2; item2 = item2->next)
+        {
+          FsCodecParameter *param = item2->data;
+
+          hash = hash * 31 + (g_str_hash (param->name) ^
+              g_str_hash (param->value));
+        }
+
+      for (item2 = fscodec->feedback_params; item2; item2 = item2->next)
+        {
+          FsFeedbackParameter *fb = item2->data;
+
+          hash = hash * 31 + (g_str_hash (fb->type) ^
+              g_str_hash (fb->subtype));
+        }
+    }
+
+  return hash;
+}
+
+/* While the configuration of the codecs is being discovered, the complete
+ * codecs cached from an earlier call can be used if they are the same ones */
+static GList *
+tf_call_content_get_cached_codecs (TfCallContent *self)
+{
+  GList *cached, *codecs, *item, *item2;
+
+  if (!_tf_codec_cache_is_enabled ())
+    return NULL;
+
+  cached = _tf_codec_cache_lookup (tf_call_content_get_fs_media_type (self),
+      self->conference_type);
+  if (cached == NULL)
+    return NULL;
+
+  g_object_get (self->fssession, "codecs-without-config", &codecs, NULL);
+
+  for (item = codecs, item2 = cached;
+       item && item2;
+       item = item->next, item2 = item2->next)
+    {
+      FsCodec *codec = item->data;
+      FsCodec *cached_codec = item2->data;
+
+      if (codec->id != cached_codec->id ||
+          g_ascii_strcasecmp (codec->encoding_name,
+              cached_codec->encoding_name) ||
+          codec->clock_rate != cached_codec->clock_rate ||
+          codec->channels != cached_codec->channels)
+        break;
+    }
+
+  if (item || item2)
+    {
+      TF_DEBUG (CODECS, "Cached codecs do not match, not using them");
+      fs_codec_list_destroy (cached);
+      cached = NULL;
+    }
+  else
+    {
+      TF_DEBUG (CODECS, "Using cached codecs until the codec configuration"
+          " is known");
+    }
+
+  fs_codec_list_destroy (codecs);
+
+  return cached;
+}
+
+static gboolean
+tf_call_content_all_contacts_updated (TfCallContent *self)
+{
+  gboolean updated = TRUE;
+  guint i;
+
+  TF_CALL_CONTENT_LOCK (self);
+  for (i = 0; i < self->fsstreams->len && updated; i++)
+    {
+      struct CallFsStream *cfs = g_ptr_array_index (self->fsstreams, i);
+
+      updated = g_hash_table_lookup_extended (self->last_sent_handles,
+          GUINT_TO_POINTER (cfs->contact_handle), NULL, NULL);
+    }
+  TF_CALL_CONTENT_UNLOCK (self);
+
+  return updated;
 }
 
 static void
@@ -1956,16 +2405,29 @@ tf_call_content_try_sending_codecs (TfCallContent *self)
   GList *codecs;
   GHashTable *media_description;
   const gchar *codecs_prop = NULL;
+  guint fingerprint;
+  gboolean want_rtp_hdrext, want_rtcp_fb;
+  gboolean unchanged;
+  GArray *update_handles;
   guint i;
 
+  /* Sending now supersedes any coalesced update still pending */
+  if (self->codecs_changed_source)
+    {
+      g_source_destroy (self->codecs_changed_source);
+      g_source_unref (self->codecs_changed_source);
+    }
+  self->codecs_changed_source = NULL;
+
   if (self->current_md_fscodecs != NULL)
   {
-    g_debug ("Ignoring updated codecs unprocessed media description"
-        " outstanding");
+    TF_DEBUG (CONTENT, "Ignoring updated codecs unprocessed media"
+        " description outstanding");
     return;
   }
 
-  g_debug ("updating local codecs: %d", TF_CONTENT (self)->sending_count);
+  TF_DEBUG (CONTENT, "updating local codecs: %d",
+      TF_CONTENT (self)->sending_count);
 
   if (TF_CONTENT (self)->sending_count == 0)
     codecs_prop = "codecs-without-config";
@@ -1974,32 +2436,86 @@ tf_call_content_try_sending_codecs (TfCallContent *self)
 
   g_object_get (self->fssession, codecs_prop, &codecs, NULL);
 
+  if (TF_CONTENT (self)->sending_count > 0)
+    {
+      if (codecs)
+        _tf_codec_cache_store (tf_call_content_get_fs_media_type (self),
+            self->conference_type, codecs);
+      else
+        codecs = tf_call_content_get_cached_codecs (self);
+    }
+
   if (!codecs)
     return;
 
-  media_description = fscodecs_to_media_descriptions (self, codecs);
+  fingerprint = fscodecs_fingerprint (codecs);
+  want_rtp_hdrext = (self->current_media_description &&
+      self->current_has_rtp_hdrext) || self->has_rtp_hdrext;
+  want_rtcp_fb = (self->current_media_description &&
+      self->current_has_rtcp_fb) || self->has_rtcp_fb;
+
+  unchanged = (self->last_media_description &&
+      fingerprint == self->last_sent_fingerprint &&
+      fs_codec_list_are_equal (codecs, self->last_sent_codecs));
+
+  if (unchanged)
+    {
+      /* Nothing to tell anyone unless we're answering an offer or some
+       * contacts were added since the last update */
+      if (!self->current_media_description &&
+          tf_call_content_all_contacts_updated (self))
+        {
+          TF_DEBUG (CONTENT, "Local codecs unchanged, not updating");
+          fs_codec_list_destroy (codecs);
+          return;
+        }
+
+      /* No codec needs to be marked as updated, the last description can be
+       * reused if it has the same interfaces */
+      if (want_rtp_hdrext == self->last_md_rtp_hdrext &&
+          want_rtcp_fb == self->last_md_rtcp_fb &&
+          !tp_asv_get_boolean (self->last_media_description,
+              TP_PROP_CALL_CONTENT_MEDIA_DESCRIPTION_FURTHER_NEGOTIATION_REQUIRED,
+              NULL))
+        media_description = g_boxed_copy (
+            TP_HASH_TYPE_MEDIA_DESCRIPTION_PROPERTIES,
+            self->last_media_description);
+      else
+        media_description = fscodecs_to_media_descriptions (self, codecs);
+    }
+  else
+    {
+      media_description = fscodecs_to_media_descriptions (self, codecs);
+    }
+
   if (!media_description)
     {
       fs_codec_list_destroy (codecs);
       return;
     }
 
+  update_handles = g_array_new (FALSE, FALSE, sizeof (guint));
+
   TF_CALL_CONTENT_LOCK (self);
 
+  if (!unchanged)
+    g_hash_table_remove_all (self->last_sent_handles);
+
   for (i = 0; i < self->fsstreams->len; i++)
     {
       struct CallFsStream *cfs = g_ptr_array_index (self->fsstreams, i);
-
-      tp_asv_set_uint32 (media_description,
-        TP_PROP_CALL_CONTENT_MEDIA_DESCRIPTION_REMOTE_CONTACT,
-        cfs->contact_handle);
+      gpointer handle = GUINT_TO_POINTER (cfs->contact_handle);
 
       if (self->current_media_description &&
           self->current_md_contact_handle == cfs->contact_handle)
         {
-          g_debug ("Accepting Media Description for contact: %u",
+          TF_DEBUG (DBUS, "Accepting Media Description for contact: %u",
           cfs->contact_handle);
 
+          tp_asv_set_uint32 (media_description,
+            TP_PROP_CALL_CONTENT_MEDIA_DESCRIPTION_REMOTE_CONTACT,
+            cfs->contact_handle);
+
           tp_cli_call_content_media_description_call_accept (
             self->current_media_description, -1, media_description,
             NULL, NULL, NULL, NULL);
@@ -2007,27 +2523,63 @@ tf_call_content_try_sending_codecs (TfCallContent *self)
           g_object_unref (self->current_media_description);
           self->current_media_description = NULL;
         }
-      else
+      else if (!g_hash_table_lookup_extended (self->last_sent_handles,
+              handle, NULL, NULL))
         {
-          g_debug ("Updating local Media Description for contact %u",
-            cfs->contact_handle);
-
-          tp_cli_call_content_interface_media_call_update_local_media_description (
-            self->proxy, -1, media_description,
-            media_description_updated_cb, NULL, NULL, NULL);
+          g_array_append_val (update_handles, cfs->contact_handle);
         }
+
+      g_hash_table_insert (self->last_sent_handles, handle, NULL);
     }
 
   TF_CALL_CONTENT_UNLOCK (self);
 
+  /* Everyone else gets the same description, so if the application says
+   * the CM supports it, send it only once with RemoteContact set to 0 */
+  if (update_handles->len > 1 && self->call_channel &&
+      self->call_channel->shared_media_description &&
+      !self->no_shared_media_description)
+    {
+      struct SharedMediaDescription *smd =
+          g_slice_new (struct SharedMediaDescription);
+
+      TF_DEBUG (DBUS, "Updating local Media Description for %u contacts",
+          update_handles->len);
+
+      tp_asv_set_uint32 (media_description,
+          TP_PROP_CALL_CONTENT_MEDIA_DESCRIPTION_REMOTE_CONTACT, 0);
+
+      smd->media_description = g_boxed_copy (
+          TP_HASH_TYPE_MEDIA_DESCRIPTION_PROPERTIES, media_description);
+      smd->contact_handles = g_array_ref (update_handles);
+
+      tp_cli_call_content_interface_media_call_update_local_media_description (
+          self->proxy, -1, media_description,
+          shared_media_description_updated_cb, smd,
+          shared_media_description_free, G_OBJECT (self));
+    }
+  else
+    {
+      update_local_media_description_per_contact (self, media_description,
+          update_handles);
+    }
+
+  g_array_unref (update_handles);
+
   if (media_description)
     {
       fs_codec_list_destroy (self->last_sent_codecs);
       self->last_sent_codecs = codecs;
+      self->last_sent_fingerprint = fingerprint;
       self->has_rtcp_fb = self->current_has_rtcp_fb;
       self->has_rtp_hdrext = self->current_has_rtp_hdrext;
 
-      g_boxed_free (TP_HASH_TYPE_MEDIA_DESCRIPTION_PROPERTIES, media_description);
+      if (self->last_media_description)
+        g_boxed_free (TP_HASH_TYPE_MEDIA_DESCRIPTION_PROPERTIES,
+            self->last_media_description);
+      self->last_media_description = media_description;
+      self->last_md_rtp_hdrext = want_rtp_hdrext;
+      self->last_md_rtcp_fb = want_rtcp_fb;
     }
 }
 
@@ -2090,6 +2642,33 @@ tf_call_content_dtmf_stopped (TfCallContent *self, FsDTMFMethod method)
 }
 
 
+static gboolean
+codecs_changed_timeout (gpointer user_data)
+{
+  TfCallContent *self = user_data;
+
+  g_source_unref (self->codecs_changed_source);
+  self->codecs_changed_source = NULL;
+
+  if (self->call_channel != NULL)
+    tf_call_content_try_sending_codecs (self);
+
+  return FALSE;
+}
+
+/* Farstream tends to emit codecs-changed several times in a row while it
+ * discovers the codec configuration, only send the last state */
+static void
+tf_call_content_schedule_sending_codecs (TfCallContent *self)
+{
+  if (self->call_channel == NULL || self->codecs_changed_source)
+    return;
+
+  self->codecs_changed_source = attach_timeout_source (
+      self->call_channel->context, self->codec_update_delay,
+      codecs_changed_timeout, self);
+}
+
 gboolean
 tf_call_content_bus_message (TfCallContent *content,
     GstMessage *message)
@@ -2102,7 +2681,6 @@ tf_call_content_bus_message (TfCallContent *content,
   GList *secondary_codecs;
   FsError error_no;
   const gchar *error_msg;
-  guint i;
 
 
   /* Guard against early disposal */
@@ -2134,14 +2712,14 @@ tf_call_content_bus_message (TfCallContent *content,
     }
   else if (fs_session_parse_codecs_changed (content->fssession, message))
     {
-      g_debug ("Codecs changed");
+      TF_DEBUG (CODECS, "Codecs changed");
 
-      tf_call_content_try_sending_codecs (content);
+      tf_call_content_schedule_sending_codecs (content);
     }
   else if (fs_session_parse_telephony_event_started (content->fssession,
           message, &method, &event, &volume))
     {
-      g_debug ("DTMF started: method: %d event: %u volume: %u",
+      TF_DEBUG (CONTENT, "DTMF started: method: %d event: %u volume: %u",
           method, event, volume);
 
       tf_call_content_dtmf_started (content, method, event, volume);
@@ -2149,7 +2727,7 @@ tf_call_content_bus_message (TfCallContent *content,
   else if (fs_session_parse_telephony_event_stopped (content->fssession,
           message, &method))
     {
-      g_debug ("DTMF stopped: method: %d", method);
+      TF_DEBUG (CONTENT, "DTMF stopped: method: %d", method);
 
       tf_call_content_dtmf_stopped (content, method);
     }
@@ -2159,16 +2737,19 @@ tf_call_content_bus_message (TfCallContent *content,
       gchar *tmp;
       guint i = 1;
 
-      tmp = fs_codec_to_string (codec);
-      g_debug ("Send codec changed: %s", tmp);
-      g_free (tmp);
-
-      while (secondary_codecs)
+      if (TF_DEBUG_ON (CODECS))
         {
-          tmp = fs_codec_to_string (secondary_codecs->data);
-          g_debug ("Secondary send codec %u changed: %s", i++, tmp);
+          tmp = fs_codec_to_string (codec);
+          g_debug ("Send codec changed: %s", tmp);
           g_free (tmp);
-          secondary_codecs = secondary_codecs->next;
+
+          while (secondary_codecs)
+            {
+              tmp = fs_codec_to_string (secondary_codecs->data);
+              g_debug ("Secondary send codec %u changed: %s", i++, tmp);
+              g_free (tmp);
+              secondary_codecs = secondary_codecs->next;
+            }
         }
     }
   else
@@ -2176,11 +2757,6 @@ tf_call_content_bus_message (TfCallContent *content,
       ret = FALSE;
     }
 
-  for (i = 0; i < content->streams->len; i++)
-    if (tf_call_stream_bus_message (g_ptr_array_index (content->streams, i),
-            message))
-      return TRUE;
-
   return ret;
 }
 
@@ -2237,25 +2813,22 @@ static FsStream *
 tf_call_content_get_existing_fsstream_by_handle (TfCallContent *content,
     guint contact_handle)
 {
-  guint i;
+  struct CallFsStream *cfs;
+  FsStream *s = NULL;
 
   TF_CALL_CONTENT_LOCK (content);
 
-  for (i = 0; i < content->fsstreams->len; i++)
+  cfs = g_hash_table_lookup (content->fsstreams_by_handle,
+      GUINT_TO_POINTER (contact_handle));
+  if (cfs)
     {
-      struct CallFsStream *cfs = g_ptr_array_index (content->fsstreams, i);
-
-      if (cfs->contact_handle == contact_handle)
-        {
-          cfs->use_count++;
-          TF_CALL_CONTENT_UNLOCK (content);
-          return cfs->fsstream;
-        }
+      cfs->use_count++;
+      s = cfs->fsstream;
     }
 
   TF_CALL_CONTENT_UNLOCK (content);
 
-  return NULL;
+  return s;
 }
 
 
@@ -2308,8 +2881,14 @@ _tf_call_content_get_fsstream_by_handle (TfCallContent *content,
   tp_g_signal_connect_object (s, "src-pad-added",
       G_CALLBACK (src_pad_added), content, 0);
 
+  TF_CALL_CONTENT_LOCK (content);
   g_ptr_array_add (content->fsstreams, cfs);
-  content->fsstreams_cookie ++;
+  g_hash_table_insert (content->fsstreams_by_handle,
+      GUINT_TO_POINTER (contact_handle), cfs);
+  g_hash_table_insert (content->fsstreams_by_fsstream, s, cfs);
+  tf_call_content_publish_fsstreams (content);
+  TF_CALL_CONTENT_UNLOCK (content);
+
   if (content->current_media_description != NULL
       && content->current_md_contact_handle == contact_handle)
   {
@@ -2332,23 +2911,24 @@ _tf_call_content_get_fsstream_by_handle (TfCallContent *content,
 void
 _tf_call_content_put_fsstream (TfCallContent *content, FsStream *fsstream)
 {
-  guint i;
+  struct CallFsStream *cfs;
   struct CallFsStream *fs_cfs = NULL;
 
   TF_CALL_CONTENT_LOCK (content);
-  for (i = 0; i < content->fsstreams->len; i++)
+  cfs = g_hash_table_lookup (content->fsstreams_by_fsstream, fsstream);
+  if (cfs)
     {
-      struct CallFsStream *cfs = g_ptr_array_index (content->fsstreams, i);
-
-      if (cfs->fsstream == fsstream)
+      cfs->use_count--;
+      if (cfs->use_count <= 0)
         {
-          cfs->use_count--;
-          if (cfs->use_count <= 0)
-            {
-              fs_cfs = g_ptr_array_remove_index_fast (content->fsstreams, i);
-              content->fsstreams_cookie++;
-            }
-          break;
+          g_ptr_array_remove_fast (content->fsstreams, cfs);
+          g_hash_table_remove (content->fsstreams_by_handle,
+              GUINT_TO_POINTER (cfs->contact_handle));
+          g_hash_table_remove (content->last_sent_handles,
+              GUINT_TO_POINTER (cfs->contact_handle));
+          g_hash_table_remove (content->fsstreams_by_fsstream, fsstream);
+          tf_call_content_publish_fsstreams (content);
+          fs_cfs = cfs;
         }
     }
   TF_CALL_CONTENT_UNLOCK (content);
@@ -2357,6 +2937,12 @@ _tf_call_content_put_fsstream (TfCallContent *content, FsStream *fsstream)
     free_content_fsstream (fs_cfs);
 }
 
+TfCallChannel *
+_tf_call_content_get_call_channel (TfCallContent *content)
+{
+  return content->call_channel;
+}
+
 FsMediaType
 tf_call_content_get_fs_media_type (TfCallContent *content)
 {
@@ -2367,28 +2953,18 @@ static void
 src_pad_added (FsStream *fsstream, GstPad *pad, FsCodec *codec,
     TfCallContent *content)
 {
-  guint handle = 0;
-  guint i;
+  struct FsStreamsSnapshot *snapshot;
+  guint handle;
 
-  TF_CALL_CONTENT_LOCK (content);
-
-  if (!content->fsstreams)
-    {
-      TF_CALL_CONTENT_UNLOCK (content);
-      return;
-    }
+  /* This is called from a streaming thread, don't wait for the content
+   * lock */
+  snapshot = tf_call_content_get_fsstreams_snapshot (content);
+  if (!snapshot)
+    return;
 
-  for (i = 0; i < content->fsstreams->len; i++)
-    {
-      struct CallFsStream *cfs = g_ptr_array_index (content->fsstreams, i);
-      if (cfs->fsstream == fsstream)
-        {
-          handle = cfs->contact_handle;
-          break;
-        }
-    }
-
-  TF_CALL_CONTENT_UNLOCK (content);
+  handle = GPOINTER_TO_UINT (g_hash_table_lookup (snapshot->by_fsstream,
+          fsstream));
+  fsstreams_snapshot_unref (snapshot);
 
   _tf_content_emit_src_pad_added (TF_CONTENT (content), handle,
       fsstream, pad, codec);
@@ -2400,7 +2976,7 @@ struct StreamSrcPadIterator {
   GArray *handles;
   GArray *handles_backup;
 
-  TfCallContent *self;
+  struct FsStreamsSnapshot *snapshot;
 };
 
 
@@ -2419,7 +2995,8 @@ streams_src_pads_iter_copy (const GstIterator *orig, GstIterator *copy)
       iter_orig->handles->len);
   g_array_append_vals (iter->handles_backup, iter_orig->handles_backup->data,
       iter_orig->handles_backup->len);
-  iter->self = g_object_ref (iter_orig->self);
+  iter->snapshot = iter_orig->snapshot;
+  g_atomic_int_inc (&iter->snapshot->refcount);
 }
 
 
@@ -2427,38 +3004,32 @@ static GstIteratorResult
 streams_src_pads_iter_next (GstIterator *it, GValue *result)
 {
   struct StreamSrcPadIterator *iter = (struct StreamSrcPadIterator *) it;
-
-  guint i;
+  FsStream *fsstream;
 
   if (iter->handles->len == 0)
     return GST_ITERATOR_DONE;
 
-  for (i = 0; i < iter->self->fsstreams->len; i++)
-    {
-      struct CallFsStream *cfs = g_ptr_array_index (iter->self->fsstreams, i);
+  fsstream = g_hash_table_lookup (iter->snapshot->by_handle,
+      GUINT_TO_POINTER (g_array_index (iter->handles, guint, 0)));
+  if (fsstream == NULL)
+    return GST_ITERATOR_ERROR;
 
-      if (cfs->contact_handle == g_array_index (iter->handles, guint, 0))
-        {
-          g_array_remove_index_fast (iter->handles, 0);
-          g_value_unset (result);
-          g_value_init (result, G_TYPE_POINTER);
-          g_value_set_pointer (result, cfs);
-          return GST_ITERATOR_OK;
-        }
-    }
-
-  return GST_ITERATOR_ERROR;
+  g_array_remove_index_fast (iter->handles, 0);
+  g_value_unset (result);
+  g_value_init (result, G_TYPE_POINTER);
+  g_value_set_pointer (result, fsstream);
+  return GST_ITERATOR_OK;
 
 }
 
 static GstIteratorItem
 streams_src_pads_iter_item (GstIterator *it, const GValue *item)
 {
-  struct CallFsStream *cfs = g_value_get_pointer (item);
+  FsStream *fsstream = g_value_get_pointer (item);
 
   g_value_unset ((GValue*) item);
 
-  gst_iterator_push (it, fs_stream_iterate_src_pads (cfs->fsstream));
+  gst_iterator_push (it, fs_stream_iterate_src_pads (fsstream));
 
   return GST_ITERATOR_ITEM_SKIP;
 }
@@ -2480,7 +3051,7 @@ streams_src_pads_iter_free (GstIterator *it)
 
   g_array_unref (iter->handles);
   g_array_unref (iter->handles_backup);
-  g_object_unref (iter->self);
+  fsstreams_snapshot_unref (iter->snapshot);
 }
 
 static GstIterator *
@@ -2489,10 +3060,17 @@ tf_call_content_iterate_src_pads (TfContent *content, guint *handles,
 {
   TfCallContent *self = TF_CALL_CONTENT (content);
   struct StreamSrcPadIterator *iter;
+  struct FsStreamsSnapshot *snapshot;
+
+  snapshot = tf_call_content_get_fsstreams_snapshot (self);
+  if (!snapshot)
+    snapshot = fsstreams_snapshot_new ();
 
+  /* The snapshot never changes, so no lock is needed and the iterator
+   * never has to resync */
   iter = (struct StreamSrcPadIterator *) gst_iterator_new (
       sizeof (struct StreamSrcPadIterator), GST_TYPE_PAD,
-      self->mutex, &self->fsstreams_cookie,
+      NULL, &snapshot->cookie,
       streams_src_pads_iter_copy,
       streams_src_pads_iter_next,
       streams_src_pads_iter_item,
@@ -2504,7 +3082,7 @@ tf_call_content_iterate_src_pads (TfContent *content, guint *handles,
       handle_count);
   g_array_append_vals (iter->handles, handles, handle_count);
   g_array_append_vals (iter->handles_backup, handles, handle_count);
-  iter->self = g_object_ref (self);
+  iter->snapshot = snapshot;
 
   return (GstIterator *) iter;
 }
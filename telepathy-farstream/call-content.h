@@ -92,6 +92,7 @@ FsStream *_tf_call_content_get_fsstream_by_handle (TfCallContent *content,
     GParameter *stream_transmitter_parameters,
     GError **error);
 void _tf_call_content_put_fsstream (TfCallContent *content, FsStream *fsstream);
+TfCallChannel *_tf_call_content_get_call_channel (TfCallContent *content);
 
 FsMediaType
 tf_call_content_get_fs_media_type (TfCallContent *content);
@@ -27,6 +27,7 @@ G_BEGIN_DECLS
 
 void _tf_call_content_destroy (TfCallContent *self);
 void _tf_call_stream_destroy (TfCallStream *self);
+void _tf_call_stream_try_early_media (TfCallStream *self);
 
 G_END_DECLS
 
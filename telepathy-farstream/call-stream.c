@@ -52,8 +52,21 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "call-priv.h"
+#include "debug.h"
+#include "relay-cache.h"
+#include "stun-cache.h"
 #include "utils.h"
 
+/* Local candidates are sent at once when that many have been collected */
+#define MAX_PENDING_LOCAL_CANDIDATES 16
+
+/* Remote candidates are given to the FsStream in chunks of that many, one
+ * chunk per main loop iteration */
+#define REMOTE_CANDIDATES_CHUNK 32
+
+/* How long the FsStream creation waits for relay names to be resolved */
+#define RELAY_RESOLVE_TIMEOUT 2000
 
 G_DEFINE_TYPE (TfCallStream, tf_call_stream, G_TYPE_OBJECT);
 
@@ -90,15 +103,39 @@ tf_call_stream_init (TfCallStream *self)
   self->receiving_state = TP_STREAM_FLOW_STATE_STOPPED;
 }
 
+static void tf_call_stream_stop_waiting_for_relays (TfCallStream *self);
+static void tf_call_stream_drop_queued_remote_candidates (TfCallStream *self);
+
 void
 _tf_call_stream_destroy (TfCallStream *self)
 {
+  tf_call_stream_stop_waiting_for_relays (self);
+  tf_call_stream_drop_queued_remote_candidates (self);
+
+  if (self->candidates_flush_source)
+    {
+      g_source_destroy (self->candidates_flush_source);
+      g_source_unref (self->candidates_flush_source);
+    }
+  self->candidates_flush_source = NULL;
+
+  if (self->pending_candidates)
+    g_boxed_free (TP_ARRAY_TYPE_CANDIDATE_LIST, self->pending_candidates);
+  self->pending_candidates = NULL;
+
   if (self->proxy)
     g_object_unref (self->proxy);
   self->proxy = NULL;
 
   if (self->fsstream)
     {
+      TfCallChannel *channel =
+          _tf_call_content_get_call_channel (self->call_content);
+
+      if (channel)
+        _tf_call_channel_remove_bus_route (channel, self->fsstream,
+            G_OBJECT (self));
+
       g_object_set (self->fsstream, "direction", FS_DIRECTION_NONE, NULL);
 
       if (self->has_send_resource)
@@ -175,6 +212,7 @@ tf_call_stream_update_sending_state (TfCallStream *self)
       sending = TRUE;
       break;
     default:
+      sending = self->early_sending;
       break;
     }
 
@@ -192,8 +230,12 @@ sending_state_changed (TpCallStream *proxy,
     gpointer user_data, GObject *weak_object)
 {
   TfCallStream *self = TF_CALL_STREAM (weak_object);
+  gboolean was_early_sending = self->early_sending;
 
   self->sending_state = arg_State;
+  self->sending_state_changed = TRUE;
+  /* The CM is in charge from now on */
+  self->early_sending = FALSE;
 
   if (!self->fsstream)
     return;
@@ -232,10 +274,76 @@ sending_state_changed (TpCallStream *proxy,
           proxy, -1, TP_STREAM_FLOW_STATE_STOPPED, NULL, NULL, NULL, NULL);
       break;
     default:
+      if (was_early_sending)
+        {
+          tf_call_stream_update_sending_state (self);
+          if (arg_State == TP_STREAM_FLOW_STATE_STOPPED &&
+              self->has_send_resource)
+            {
+              _tf_content_stop_sending (TF_CONTENT (self->call_content));
+              self->has_send_resource = FALSE;
+            }
+        }
       break;
     }
 }
 
+/* Media must never flow before the local user agreed to the call, that is
+ * before accepting it or when the call was started locally */
+static gboolean
+tf_call_stream_locally_accepted (TfCallChannel *channel)
+{
+  switch (tp_call_channel_get_state (TP_CALL_CHANNEL (channel->proxy),
+          NULL, NULL, NULL))
+    {
+    case TP_CALL_STATE_ACCEPTED:
+    case TP_CALL_STATE_ACTIVE:
+      return TRUE;
+    case TP_CALL_STATE_PENDING_INITIATOR:
+    case TP_CALL_STATE_INITIALISING:
+    case TP_CALL_STATE_INITIALISED:
+      return tp_channel_get_requested (channel->proxy);
+    default:
+      return FALSE;
+    }
+}
+
+/* With early media, the stream starts sending as soon as it has the remote
+ * codecs and an active candidate pair, instead of waiting for the round trip
+ * through the CM. sending_state_changed() reconciles it with the CM later */
+void
+_tf_call_stream_try_early_media (TfCallStream *self)
+{
+  TfCallChannel *channel;
+  GList *remote_codecs = NULL;
+
+  if (self->fsstream == NULL || self->call_content == NULL ||
+      self->early_sending || self->sending_state_changed ||
+      self->sending_state != TP_STREAM_FLOW_STATE_STOPPED ||
+      !self->has_active_candidate_pair)
+    return;
+
+  channel = _tf_call_content_get_call_channel (self->call_content);
+  if (channel == NULL || !channel->early_media ||
+      !tf_call_stream_locally_accepted (channel))
+    return;
+
+  g_object_get (self->fsstream, "remote-codecs", &remote_codecs, NULL);
+  if (remote_codecs == NULL)
+    return;
+  fs_codec_list_destroy (remote_codecs);
+
+  if (!self->has_send_resource &&
+      !_tf_content_start_sending (TF_CONTENT (self->call_content)))
+    return;
+
+  TF_DEBUG (STREAM, "Starting early media");
+
+  self->has_send_resource = TRUE;
+  self->early_sending = TRUE;
+  tf_call_stream_update_sending_state (self);
+}
+
 static gboolean
 tf_call_stream_start_receiving (TfCallStream *self, FsStreamDirection dir)
 {
@@ -340,6 +448,88 @@ _tf_call_stream_push_remote_candidates (TfCallStream *self,
   fs_candidate_list_destroy (fscandidates);
 }
 
+static void
+tf_call_stream_stop_waiting_for_relays (TfCallStream *self)
+{
+  if (self->relays_resolved_source)
+    {
+      _tf_relay_cache_cancel_wait (self->relays_resolved_source);
+      g_source_destroy (self->relays_resolved_source);
+      g_source_unref (self->relays_resolved_source);
+    }
+  self->relays_resolved_source = NULL;
+
+  if (self->relays_timeout_source)
+    {
+      g_source_destroy (self->relays_timeout_source);
+      g_source_unref (self->relays_timeout_source);
+    }
+  self->relays_timeout_source = NULL;
+}
+
+static void tf_call_stream_try_adding_fsstream (TfCallStream *self);
+
+static gboolean
+relays_resolved (gpointer user_data)
+{
+  TfCallStream *self = user_data;
+
+  g_source_unref (self->relays_resolved_source);
+  self->relays_resolved_source = NULL;
+
+  tf_call_stream_try_adding_fsstream (self);
+
+  return FALSE;
+}
+
+static gboolean
+relays_timeout (gpointer user_data)
+{
+  TfCallStream *self = user_data;
+
+  g_debug ("Timed out resolving the relay servers");
+
+  g_source_unref (self->relays_timeout_source);
+  self->relays_timeout_source = NULL;
+  self->relays_wait_over = TRUE;
+
+  tf_call_stream_try_adding_fsstream (self);
+
+  return FALSE;
+}
+
+/* The transmitter only takes relay addresses, so when pre-gathering, the
+ * FsStream creation is held back for a little while if some relays given by
+ * name are being resolved for the first time. Otherwise the resolution had
+ * until the server info was retrieved. Returns TRUE while waiting */
+static gboolean
+tf_call_stream_wait_for_relays (TfCallStream *self, TfCallChannel *channel)
+{
+  if (self->relays_wait_over)
+    return FALSE;
+
+  if (self->relays_resolved_source)
+    return TRUE;
+
+  self->relays_resolved_source = g_idle_source_new ();
+  g_source_set_callback (self->relays_resolved_source, relays_resolved, self,
+      NULL);
+
+  if (!_tf_relay_cache_wait (self->relay_info, self->relays_resolved_source,
+          channel->context))
+    {
+      g_source_unref (self->relays_resolved_source);
+      self->relays_resolved_source = NULL;
+      return FALSE;
+    }
+
+  if (self->relays_timeout_source == NULL)
+    self->relays_timeout_source = attach_timeout_source (channel->context,
+        RELAY_RESOLVE_TIMEOUT, relays_timeout, self);
+
+  return TRUE;
+}
+
 static void
 tf_call_stream_try_adding_fsstream (TfCallStream *self)
 {
@@ -350,14 +540,28 @@ tf_call_stream_try_adding_fsstream (TfCallStream *self)
   GList *preferred_local_candidates = NULL;
   guint i;
   FsStreamDirection dir = FS_DIRECTION_NONE;
+  TfCallChannel *channel;
 
   memset (params, 0, sizeof(params));
 
-  if (!self->server_info_retrieved ||
+  if (self->fsstream ||
       !self->has_contact ||
       !self->has_media_properties)
     return;
 
+  /* When pre-gathering, the servers are good enough once both the STUN
+   * and the relay server lists were received, whatever their lengths */
+  channel = _tf_call_content_get_call_channel (self->call_content);
+  if (!self->server_info_retrieved &&
+      !(channel && channel->pre_gather_candidates &&
+          self->has_stun_servers && self->has_relay_info))
+    return;
+
+  if (channel && channel->pre_gather_candidates &&
+      tf_call_stream_wait_for_relays (self, channel))
+    return;
+  tf_call_stream_stop_waiting_for_relays (self);
+
   switch (self->transport_type)
     {
     case TP_STREAM_TRANSPORT_TYPE_RAW_UDP:
@@ -439,12 +643,15 @@ tf_call_stream_try_adding_fsstream (TfCallStream *self)
 
   if (self->stun_servers->len)
     {
-      GValueArray *gva = g_ptr_array_index (self->stun_servers, 0);
+      GValueArray *gva;
       gchar *ip;
       guint port;
       gchar *conn_timeout_str;
 
-      /* We only use the first STUN server if there are many */
+      /* The transmitter only takes one STUN server, use the one that has
+       * been answering the fastest */
+      gva = g_ptr_array_index (self->stun_servers,
+          _tf_stun_cache_pick (self->stun_servers));
 
       tp_value_array_unpack (gva, 2, &ip, &port);
 
@@ -483,6 +690,7 @@ tf_call_stream_try_adding_fsstream (TfCallStream *self)
           const gchar *username;
           const gchar *password;
           guint component;
+          gchar *address;
           GstStructure *s;
 
           ip = tp_asv_get_string (one_relay, "ip");
@@ -498,8 +706,22 @@ tf_call_stream_try_adding_fsstream (TfCallStream *self)
           if (!type)
             type = "udp";
 
+          /* The transmitter wants an address, use the one resolved in
+           * advance if the relay was given by name */
+          address = NULL;
+          if (!g_hostname_is_ip_address (ip))
+            {
+              address = _tf_relay_cache_lookup (ip);
+              if (address == NULL)
+                {
+                  g_message ("Relay server %s is not resolved yet,"
+                      " not using it", ip);
+                  continue;
+                }
+            }
+
           s = gst_structure_new ("relay-info",
-              "ip", G_TYPE_STRING, ip,
+              "ip", G_TYPE_STRING, address ? address : ip,
               "port", G_TYPE_UINT, port,
               "username", G_TYPE_STRING, username,
               "password", G_TYPE_STRING, password,
@@ -509,6 +731,8 @@ tf_call_stream_try_adding_fsstream (TfCallStream *self)
           if (component)
             gst_structure_set (s, "component", G_TYPE_UINT, component, NULL);
 
+          g_free (address);
+
 
           if (!fs_relay_info)
             fs_relay_info = g_ptr_array_new_with_free_func (
@@ -553,8 +777,13 @@ tf_call_stream_try_adding_fsstream (TfCallStream *self)
       return;
     }
 
-  _tf_call_stream_push_remote_candidates (self, self->stored_remote_candidates);
-  self->stored_remote_candidates = NULL;
+  _tf_call_channel_add_bus_route (
+      _tf_call_content_get_call_channel (self->call_content), self->fsstream,
+      G_OBJECT (self));
+
+  _tf_call_stream_push_remote_candidates (self,
+      self->stored_remote_candidates.head);
+  g_queue_init (&self->stored_remote_candidates);
 
   if (self->sending_state == TP_STREAM_FLOW_STATE_PENDING_START)
     sending_state_changed (self->proxy,
@@ -575,6 +804,32 @@ server_info_retrieved (TpCallStream *proxy,
   tf_call_stream_try_adding_fsstream (self);
 }
 
+/* Measure the STUN servers while the rest of the stream is being set up,
+ * so the FsStream can use the best one */
+static void
+tf_call_stream_probe_stun_servers (TfCallStream *self)
+{
+  TfCallChannel *channel;
+
+  channel = _tf_call_content_get_call_channel (self->call_content);
+  if (channel == NULL)
+    return;
+
+  _tf_stun_cache_probe (self->stun_servers, channel->context);
+}
+
+static void
+tf_call_stream_prepare_relays (TfCallStream *self)
+{
+  TfCallChannel *channel;
+
+  channel = _tf_call_content_get_call_channel (self->call_content);
+  if (channel == NULL)
+    return;
+
+  _tf_relay_cache_prepare (self->relay_info, channel->context);
+}
+
 static void
 relay_info_changed (TpCallStream *proxy,
     const GPtrArray *arg_Relay_Info,
@@ -598,9 +853,17 @@ relay_info_changed (TpCallStream *proxy,
   if (!self->relay_info)
     return;
 
+  if (self->fsstream)
+    TF_DEBUG (STREAM, "Relay servers changed after pre-gathering started,"
+        " they will not be used");
+
   g_boxed_free (TP_ARRAY_TYPE_STRING_VARIANT_MAP_LIST, self->relay_info);
   self->relay_info = g_boxed_copy (TP_ARRAY_TYPE_STRING_VARIANT_MAP_LIST,
       arg_Relay_Info);
+  self->has_relay_info = TRUE;
+  tf_call_stream_prepare_relays (self);
+
+  tf_call_stream_try_adding_fsstream (self);
 }
 
 static void
@@ -626,9 +889,17 @@ stun_servers_changed (TpCallStream *proxy,
   if (!self->stun_servers)
     return;
 
+  if (self->fsstream)
+    TF_DEBUG (STREAM, "STUN servers changed after pre-gathering started,"
+        " they will not be used");
+
   g_boxed_free (TP_ARRAY_TYPE_SOCKET_ADDRESS_IP_LIST, self->stun_servers);
   self->stun_servers = g_boxed_copy (TP_ARRAY_TYPE_SOCKET_ADDRESS_IP_LIST,
       arg_Servers);
+  self->has_stun_servers = TRUE;
+  tf_call_stream_probe_stun_servers (self);
+
+  tf_call_stream_try_adding_fsstream (self);
 }
 
 static FsCandidateType
@@ -670,11 +941,142 @@ tpnetworkproto_to_fs (TpMediaStreamBaseProto proto)
     }
 }
 
+struct RemoteCandidateInfo {
+  const gchar *foundation;
+  guint priority;
+  const gchar *username;
+  const gchar *password;
+  guint type;
+  guint protocol;
+  guint ttl;
+  const gchar *base_ip;
+  guint base_port;
+};
+
+/* Like tp_asv_get_uint32(), for a value we already have */
+static gboolean
+value_get_uint32 (const GValue *value, guint *out)
+{
+  if (G_VALUE_HOLDS_UINT (value))
+    *out = g_value_get_uint (value);
+  else if (G_VALUE_HOLDS_INT (value) && g_value_get_int (value) >= 0)
+    *out = g_value_get_int (value);
+  else if (G_VALUE_HOLDS_UCHAR (value))
+    *out = g_value_get_uchar (value);
+  else if (G_VALUE_HOLDS_UINT64 (value) &&
+      g_value_get_uint64 (value) <= G_MAXUINT32)
+    *out = g_value_get_uint64 (value);
+  else if (G_VALUE_HOLDS_INT64 (value) && g_value_get_int64 (value) >= 0 &&
+      g_value_get_int64 (value) <= G_MAXUINT32)
+    *out = g_value_get_int64 (value);
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+/* Walks the candidate info once instead of looking up every key, the
+ * members of @info that are not in it are left untouched */
+static void
+parse_remote_candidate_info (GHashTable *extra_info,
+    struct RemoteCandidateInfo *info)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init (&iter, extra_info);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      const gchar *name = key;
+
+      if (G_VALUE_HOLDS_STRING (value))
+        {
+          if (!strcmp (name, "foundation"))
+            info->foundation = g_value_get_string (value);
+          else if (!strcmp (name, "username"))
+            info->username = g_value_get_string (value);
+          else if (!strcmp (name, "password"))
+            info->password = g_value_get_string (value);
+          else if (!strcmp (name, "base-ip"))
+            info->base_ip = g_value_get_string (value);
+        }
+      else if (!strcmp (name, "priority"))
+        value_get_uint32 (value, &info->priority);
+      else if (!strcmp (name, "type"))
+        value_get_uint32 (value, &info->type);
+      else if (!strcmp (name, "protocol"))
+        value_get_uint32 (value, &info->protocol);
+      else if (!strcmp (name, "ttl"))
+        value_get_uint32 (value, &info->ttl);
+      else if (!strcmp (name, "base-port"))
+        value_get_uint32 (value, &info->base_port);
+    }
+
+  if (info->foundation == NULL)
+    info->foundation = "";
+}
+
+static void
+tf_call_stream_drop_queued_remote_candidates (TfCallStream *self)
+{
+  if (self->remote_candidates_source)
+    {
+      g_source_destroy (self->remote_candidates_source);
+      g_source_unref (self->remote_candidates_source);
+    }
+  self->remote_candidates_source = NULL;
+
+  fs_candidate_list_destroy (self->queued_remote_candidates.head);
+  g_queue_init (&self->queued_remote_candidates);
+}
+
+/* Gives the next chunk of queued candidates to the FsStream, returns TRUE
+ * if some are left */
+static gboolean
+tf_call_stream_push_queued_remote_candidates (TfCallStream *self)
+{
+  GQueue *queue = &self->queued_remote_candidates;
+  GList *chunk = queue->head;
+  GList *last = g_list_nth (chunk, REMOTE_CANDIDATES_CHUNK - 1);
+
+  if (last && last->next)
+    {
+      queue->head = last->next;
+      queue->head->prev = NULL;
+      queue->length -= REMOTE_CANDIDATES_CHUNK;
+      last->next = NULL;
+    }
+  else
+    {
+      g_queue_init (queue);
+    }
+
+  _tf_call_stream_push_remote_candidates (self, chunk);
+
+  return queue->head != NULL;
+}
+
+static gboolean
+push_queued_remote_candidates_cb (gpointer user_data)
+{
+  TfCallStream *self = user_data;
+
+  if (tf_call_stream_push_queued_remote_candidates (self))
+    return TRUE;
+
+  g_source_unref (self->remote_candidates_source);
+  self->remote_candidates_source = NULL;
+
+  return FALSE;
+}
+
 static void
 tf_call_stream_add_remote_candidates (TfCallStream *self,
     const GPtrArray *candidates)
 {
-  GList *fscandidates = NULL;
+  GQueue local = G_QUEUE_INIT;
+  GQueue *fscandidates;
+  gboolean trickle;
   guint i;
 
   /* No candidates to add, ignore. This could either be caused by the CM
@@ -683,86 +1085,73 @@ tf_call_stream_add_remote_candidates (TfCallStream *self,
   if (candidates->len == 0)
     return;
 
+  /* Candidates that are added (rather than forced) can be given to the
+   * FsStream a chunk at a time, letting the main loop run in between */
+  trickle = self->fsstream &&
+      (self->transport_type == TP_STREAM_TRANSPORT_TYPE_ICE ||
+       self->transport_type == TP_STREAM_TRANSPORT_TYPE_GTALK_P2P ||
+       self->transport_type == TP_STREAM_TRANSPORT_TYPE_WLM_2009);
+
+  /* Without a FsStream, they are parsed straight into the stored ones */
+  if (trickle)
+    fscandidates = &self->queued_remote_candidates;
+  else if (self->fsstream)
+    fscandidates = &local;
+  else
+    fscandidates = &self->stored_remote_candidates;
+
   for (i = 0; i < candidates->len; i++)
     {
       GValueArray *tpcandidate = g_ptr_array_index (candidates, i);
+      struct RemoteCandidateInfo info = { "", 0, NULL, NULL,
+        TP_CALL_STREAM_CANDIDATE_TYPE_HOST, TP_MEDIA_STREAM_BASE_PROTO_UDP,
+        0, NULL, 0 };
       guint component;
       gchar *ip;
       guint port;
       GHashTable *extra_info;
-      const gchar *foundation;
-      guint priority;
-      const gchar *username;
-      const gchar *password;
-      gboolean valid;
       FsCandidate *cand;
-      guint type;
-      guint protocol;
-      guint ttl;
-      const gchar *base_ip;
-      guint base_port;
 
       tp_value_array_unpack (tpcandidate, 4, &component, &ip, &port,
           &extra_info);
 
-      foundation = tp_asv_get_string (extra_info, "foundation");
-      if (!foundation)
-        foundation = "";
-      priority = tp_asv_get_uint32 (extra_info, "priority", &valid);
-      if (!valid)
-        priority = 0;
-
-      username = tp_asv_get_string (extra_info, "username");
-      if (!username)
-        username = self->creds_username;
-
-      password = tp_asv_get_string (extra_info, "password");
-      if (!password)
-        password = self->creds_password;
-
-      type = tp_asv_get_uint32 (extra_info, "type", &valid);
-      if (!valid)
-        type = TP_CALL_STREAM_CANDIDATE_TYPE_HOST;
-
-      protocol = tp_asv_get_uint32 (extra_info, "protocol", &valid);
-      if (!valid)
-        protocol = TP_MEDIA_STREAM_BASE_PROTO_UDP;
-
-      base_ip = tp_asv_get_string (extra_info, "base-ip");
-      base_port = tp_asv_get_uint32 (extra_info, "base-port", &valid);
-      if (!valid)
-        base_port = 0;
-
-
-      ttl = tp_asv_get_uint32 (extra_info, "ttl", &valid);
-      if (!valid)
-        ttl = 0;
-
-      g_debug ("Remote Candidate: %s c:%d tptype:%d tpproto: %d ip:%s port:%u prio:%d u/p:%s/%s ttl:%d base_ip:%s base_port:%d",
-          foundation, component, type, protocol, ip, port, priority,
-          username, password, ttl, base_ip, base_port);
-
-      cand = fs_candidate_new (foundation, component,
-          tpcandidate_type_to_fs (type), tpnetworkproto_to_fs (protocol),
-          ip, port);
-      cand->priority = priority;
-      cand->username = g_strdup (username);
-      cand->password = g_strdup (password);
-      cand->ttl = ttl;
-      cand->base_ip = g_strdup (base_ip);
-      cand->base_port = base_port;
-
-      fscandidates = g_list_append (fscandidates, cand);
+      parse_remote_candidate_info (extra_info, &info);
+
+      if (!info.username)
+        info.username = self->creds_username;
+      if (!info.password)
+        info.password = self->creds_password;
+
+      TF_DEBUG (CANDIDATES, "Remote Candidate: %s c:%d tptype:%d tpproto: %d ip:%s port:%u prio:%d u/p:%s/%s ttl:%d base_ip:%s base_port:%d",
+          info.foundation, component, info.type, info.protocol, ip, port,
+          info.priority, info.username, info.password, info.ttl,
+          info.base_ip, info.base_port);
+
+      cand = fs_candidate_new (info.foundation, component,
+          tpcandidate_type_to_fs (info.type),
+          tpnetworkproto_to_fs (info.protocol), ip, port);
+      cand->priority = info.priority;
+      cand->username = g_strdup (info.username);
+      cand->password = g_strdup (info.password);
+      cand->ttl = info.ttl;
+      cand->base_ip = g_strdup (info.base_ip);
+      cand->base_port = info.base_port;
+
+      g_queue_push_tail (fscandidates, cand);
     }
 
-  if (self->fsstream)
+  if (trickle)
     {
-      _tf_call_stream_push_remote_candidates (self, fscandidates);
+      /* The first chunk goes now, the others from the main loop */
+      if (self->remote_candidates_source == NULL &&
+          tf_call_stream_push_queued_remote_candidates (self))
+        self->remote_candidates_source = attach_timeout_source (
+            _tf_call_content_get_call_channel (self->call_content)->context,
+            0, push_queued_remote_candidates_cb, self);
     }
-  else
+  else if (self->fsstream)
     {
-      self->stored_remote_candidates =
-          g_list_concat (self->stored_remote_candidates, fscandidates);
+      _tf_call_stream_push_remote_candidates (self, local.head);
     }
 }
 
@@ -806,8 +1195,9 @@ remote_credentials_set (TpProxy *proxy,
           " remote is doing an ICE restart");
       /* Remote credentials changed, this will perform a ICE restart, so
        * clear old remote candidates */
-      fs_candidate_list_destroy (self->stored_remote_candidates);
-      self->stored_remote_candidates = NULL;
+      fs_candidate_list_destroy (self->stored_remote_candidates.head);
+      g_queue_init (&self->stored_remote_candidates);
+      tf_call_stream_drop_queued_remote_candidates (self);
     }
 
   g_free (self->creds_username);
@@ -965,8 +1355,9 @@ _tf_call_stream_remove_endpoint (TfCallStream *self)
   self->multiple_usernames = FALSE;
   self->controlling = FALSE;
 
-  fs_candidate_list_destroy (self->stored_remote_candidates);
-  self->stored_remote_candidates = NULL;
+  fs_candidate_list_destroy (self->stored_remote_candidates.head);
+  g_queue_init (&self->stored_remote_candidates);
+  tf_call_stream_drop_queued_remote_candidates (self);
 
   g_free (self->creds_username);
   self->creds_username = NULL;
@@ -1142,8 +1533,12 @@ got_stream_media_properties (TpProxy *proxy, GHashTable *out_Properties,
 */
   self->stun_servers = g_boxed_copy (TP_ARRAY_TYPE_SOCKET_ADDRESS_IP_LIST,
       stun_servers);
+  self->has_stun_servers = TRUE;
+  tf_call_stream_probe_stun_servers (self);
   self->relay_info = g_boxed_copy (TP_ARRAY_TYPE_STRING_VARIANT_MAP_LIST,
       relay_info);
+  self->has_relay_info = TRUE;
+  tf_call_stream_prepare_relays (self);
 
   endpoints = tp_asv_get_boxed (out_Properties, "Endpoints",
       TP_ARRAY_TYPE_OBJECT_PATH_LIST);
@@ -1198,6 +1593,7 @@ ice_restart_requested (TpCallStream *proxy,
 
   if (fs_stream_add_remote_candidates (self->fsstream, NULL, &myerror))
     {
+      self->local_candidates_prepared = FALSE;
       g_free (self->last_local_username);
       g_free (self->last_local_password);
       self->last_local_username = NULL;
@@ -1368,11 +1764,20 @@ stream_prepared (GObject *src_object, GAsyncResult *res, gpointer user_data)
   return;
 }
 
+static void
+call_state_changed (TfCallStream *self)
+{
+  _tf_call_stream_try_early_media (self);
+}
+
 TfCallStream *
 tf_call_stream_new (TfCallContent *call_content,
     TpCallStream *stream_proxy)
 {
   TfCallStream *self;
+  TfCallChannel *channel;
+  GMainContext *context;
+  gboolean pushed;
 
   g_assert (call_content != NULL);
   g_assert (stream_proxy != NULL);
@@ -1382,8 +1787,18 @@ tf_call_stream_new (TfCallContent *call_content,
   self->call_content = call_content;
   self->proxy = g_object_ref (stream_proxy);
 
+  channel = _tf_call_content_get_call_channel (call_content);
+
+  /* Early media may have been held back until the call is accepted */
+  if (channel->early_media)
+    tp_g_signal_connect_object (channel->proxy, "state-changed",
+        G_CALLBACK (call_state_changed), self, G_CONNECT_SWAPPED);
+
+  context = channel->context;
+  pushed = push_thread_default_context (context);
   tp_proxy_prepare_async (self->proxy, NULL, stream_prepared,
       g_object_ref (self));
+  pop_thread_default_context (context, pushed);
 
   return self;
 }
@@ -1472,10 +1887,48 @@ fscandidate_to_tpcandidate (TfCallStream *stream, FsCandidate *candidate)
       G_TYPE_INVALID);
 }
 
+static void
+tf_call_stream_flush_local_candidates (TfCallStream *stream)
+{
+  if (stream->candidates_flush_source)
+    {
+      g_source_destroy (stream->candidates_flush_source);
+      g_source_unref (stream->candidates_flush_source);
+    }
+  stream->candidates_flush_source = NULL;
+
+  if (stream->pending_candidates == NULL)
+    return;
+
+  TF_DEBUG (DBUS, "Adding %u local candidates",
+      stream->pending_candidates->len);
+
+  /* Should also check for errors */
+  tp_cli_call_stream_interface_media_call_add_candidates (stream->proxy,
+      -1, stream->pending_candidates, NULL, NULL, NULL, NULL);
+
+  g_boxed_free (TP_ARRAY_TYPE_CANDIDATE_LIST, stream->pending_candidates);
+  stream->pending_candidates = NULL;
+}
+
+static gboolean
+local_candidates_timeout (gpointer user_data)
+{
+  TfCallStream *stream = user_data;
+
+  tf_call_stream_flush_local_candidates (stream);
+
+  return FALSE;
+}
+
 static void
 cb_fs_new_local_candidate (TfCallStream *stream, FsCandidate *candidate)
 {
-  GPtrArray *candidate_list;
+  TfCallChannel *channel;
+  guint delay;
+
+  channel = _tf_call_content_get_call_channel (stream->call_content);
+  delay = channel ? channel->candidate_batch_delay : 0;
 
   if (!stream->multiple_usernames)
     {
@@ -1486,6 +1939,9 @@ cb_fs_new_local_candidate (TfCallStream *stream, FsCandidate *candidate)
           (stream->last_local_password &&
               strcmp (candidate->password, stream->last_local_password)))
         {
+          /* The candidates collected so far go with the old credentials */
+          tf_call_stream_flush_local_candidates (stream);
+
           g_free (stream->last_local_username);
           g_free (stream->last_local_password);
           stream->last_local_username = g_strdup (candidate->username);
@@ -1504,23 +1960,26 @@ cb_fs_new_local_candidate (TfCallStream *stream, FsCandidate *candidate)
         }
     }
 
-  g_debug ("Local Candidate: %s c:%d fstype:%d fsproto: %d ip:%s port:%u prio:%d u/p:%s/%s ttl:%d base_ip:%s base_port:%d",
+  TF_DEBUG (CANDIDATES, "Local Candidate: %s c:%d fstype:%d fsproto: %d ip:%s port:%u prio:%d u/p:%s/%s ttl:%d base_ip:%s base_port:%d",
       candidate->foundation,candidate->component_id, candidate->type,
       candidate->proto, candidate->ip, candidate->port,
       candidate->priority, candidate->username, candidate->password,
       candidate->ttl,candidate-> base_ip, candidate->base_port);
 
 
-  candidate_list = g_ptr_array_sized_new (1);
-  g_ptr_array_add (candidate_list,
+  if (stream->pending_candidates == NULL)
+    stream->pending_candidates = g_ptr_array_new ();
+  g_ptr_array_add (stream->pending_candidates,
       fscandidate_to_tpcandidate (stream, candidate));
 
-  /* Should also check for errors */
-  tp_cli_call_stream_interface_media_call_add_candidates (stream->proxy,
-      -1, candidate_list, NULL, NULL, NULL, NULL);
-
-
-  g_boxed_free (TP_ARRAY_TYPE_CANDIDATE_LIST, candidate_list);
+  /* Candidates found after the initial ones are never held for long */
+  if (delay == 0 ||
+      stream->pending_candidates->len >= MAX_PENDING_LOCAL_CANDIDATES ||
+      (delay == G_MAXUINT && stream->local_candidates_prepared))
+    tf_call_stream_flush_local_candidates (stream);
+  else if (stream->candidates_flush_source == NULL && delay != G_MAXUINT)
+    stream->candidates_flush_source = attach_timeout_source (channel->context,
+        delay, local_candidates_timeout, stream);
 }
 
 static void
@@ -1528,6 +1987,9 @@ cb_fs_local_candidates_prepared (TfCallStream *stream)
 {
   g_debug ("Local candidates prepared");
 
+  stream->local_candidates_prepared = TRUE;
+  tf_call_stream_flush_local_candidates (stream);
+
   tp_cli_call_stream_interface_media_call_finish_initial_candidates (
       stream->proxy, -1, NULL, NULL, NULL, NULL);
 }
@@ -1584,6 +2046,9 @@ cb_fs_new_active_candidate_pair (TfCallStream *stream,
   if (!stream->endpoint)
     return;
 
+  stream->has_active_candidate_pair = TRUE;
+  _tf_call_stream_try_early_media (stream);
+
   local_tp_candidate = fscandidate_to_tpcandidate (stream, local_candidate);
   remote_tp_candidate = fscandidate_to_tpcandidate (stream, remote_candidate);
 
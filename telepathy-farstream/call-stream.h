@@ -82,15 +82,29 @@ struct _TfCallStream {
   TpProxy *endpoint;
   gchar *creds_username;
   gchar *creds_password;
-  GList *stored_remote_candidates;
+  GQueue stored_remote_candidates;
+  /* Remote candidates given to the FsStream a chunk per main loop
+   * iteration */
+  GQueue queued_remote_candidates;
+  GSource *remote_candidates_source;
   gboolean multiple_usernames;
   gboolean controlling;
 
   gchar *last_local_username;
   gchar *last_local_password;
 
+  /* Local candidates not given to the CM yet */
+  GPtrArray *pending_candidates;
+  GSource *candidates_flush_source;
+  gboolean local_candidates_prepared;
+
   TpStreamFlowState sending_state;
   gboolean has_send_resource;
+  /* The CM has changed the sending state since the stream appeared */
+  gboolean sending_state_changed;
+  /* Sending before the CM asked for it, see TfChannel:early-media */
+  gboolean early_sending;
+  gboolean has_active_candidate_pair;
 
   TpStreamFlowState receiving_state;
   gboolean has_receive_resource;
@@ -104,6 +118,13 @@ struct _TfCallStream {
   gboolean server_info_retrieved;
   GPtrArray *stun_servers;
   GPtrArray *relay_info;
+  /* The lists were received from the CM, even if empty */
+  gboolean has_stun_servers;
+  gboolean has_relay_info;
+  /* Waiting for the relays given by name to be resolved */
+  GSource *relays_resolved_source;
+  GSource *relays_timeout_source;
+  gboolean relays_wait_over;
 };
 
 struct _TfCallStreamClass{
@@ -0,0 +1,284 @@
+/*
+ * channel-set.c - Source for TfChannelSet
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * SECTION:channel-set
+ * @short_description: Route the bus messages of many #TfChannel objects
+ *
+ * A #TfChannelSet holds many #TfChannel objects whose conferences are in
+ * the same pipeline. It watches the pipeline's bus once and hands each
+ * message only to the channel owning the #FsConference that posted it,
+ * instead of the application offering every message to every channel.
+ */
+
+#include "config.h"
+
+#include "channel-set.h"
+
+#include <farstream/fs-conference.h>
+
+struct _TfChannelSet {
+  GObject parent;
+
+  /*< private >*/
+
+  GstBus *bus;
+  gulong message_handler;
+
+  GHashTable *channels; /* TfChannel -> itself, reffed */
+  GHashTable *conferences; /* FsConference -> TfChannel */
+};
+
+struct _TfChannelSetClass {
+  GObjectClass parent_class;
+
+  /*< private >*/
+
+  gpointer unused[4];
+};
+
+G_DEFINE_TYPE (TfChannelSet, tf_channel_set, G_TYPE_OBJECT);
+
+static void tf_channel_set_dispose (GObject *object);
+static void tf_channel_set_finalize (GObject *object);
+
+static void
+tf_channel_set_class_init (TfChannelSetClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = tf_channel_set_dispose;
+  object_class->finalize = tf_channel_set_finalize;
+}
+
+static void
+tf_channel_set_init (TfChannelSet *self)
+{
+  self->channels = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, g_object_unref);
+  self->conferences = g_hash_table_new (g_direct_hash, g_direct_equal);
+}
+
+static void
+disconnect_channel (gpointer key, gpointer value, gpointer user_data)
+{
+  g_signal_handlers_disconnect_matched (key, G_SIGNAL_MATCH_DATA,
+      0, 0, NULL, NULL, user_data);
+}
+
+static void
+tf_channel_set_dispose (GObject *object)
+{
+  TfChannelSet *self = TF_CHANNEL_SET (object);
+
+  g_debug (G_STRFUNC);
+
+  if (self->bus)
+    {
+      g_signal_handler_disconnect (self->bus, self->message_handler);
+      gst_bus_remove_signal_watch (self->bus);
+      gst_object_unref (self->bus);
+    }
+  self->bus = NULL;
+
+  g_hash_table_foreach (self->channels, disconnect_channel, self);
+  g_hash_table_remove_all (self->channels);
+  g_hash_table_remove_all (self->conferences);
+
+  if (G_OBJECT_CLASS (tf_channel_set_parent_class)->dispose)
+    G_OBJECT_CLASS (tf_channel_set_parent_class)->dispose (object);
+}
+
+static void
+tf_channel_set_finalize (GObject *object)
+{
+  TfChannelSet *self = TF_CHANNEL_SET (object);
+
+  g_hash_table_unref (self->channels);
+  g_hash_table_unref (self->conferences);
+
+  if (G_OBJECT_CLASS (tf_channel_set_parent_class)->finalize)
+    G_OBJECT_CLASS (tf_channel_set_parent_class)->finalize (object);
+}
+
+static void
+bus_message (GstBus *bus, GstMessage *message, TfChannelSet *self)
+{
+  tf_channel_set_bus_message (self, message);
+}
+
+/**
+ * tf_channel_set_new:
+ * @bus: (allow-none): the #GstBus of the pipeline the channels'
+ *  conferences are added to, or %NULL
+ *
+ * Creates a new empty #TfChannelSet. If @bus is not %NULL, a signal watch
+ * is added to it and its messages are routed to the channels of the set,
+ * the application then no longer has to call tf_channel_bus_message().
+ * Otherwise, the application should pass the messages from its own bus
+ * watch to tf_channel_set_bus_message().
+ *
+ * Returns: a new #TfChannelSet
+ *
+ * Since: 0.6.3
+ */
+
+TfChannelSet *
+tf_channel_set_new (GstBus *bus)
+{
+  TfChannelSet *self;
+
+  g_return_val_if_fail (bus == NULL || GST_IS_BUS (bus), NULL);
+
+  self = g_object_new (TF_TYPE_CHANNEL_SET, NULL);
+
+  if (bus)
+    {
+      self->bus = gst_object_ref (bus);
+      gst_bus_add_signal_watch (bus);
+      self->message_handler = g_signal_connect (bus, "message",
+          G_CALLBACK (bus_message), self);
+    }
+
+  return self;
+}
+
+static void
+channel_fs_conference_added (TfChannel *channel, FsConference *conf,
+    TfChannelSet *self)
+{
+  g_hash_table_insert (self->conferences, conf, channel);
+}
+
+static void
+channel_fs_conference_removed (TfChannel *channel, FsConference *conf,
+    TfChannelSet *self)
+{
+  if (g_hash_table_lookup (self->conferences, conf) == channel)
+    g_hash_table_remove (self->conferences, conf);
+}
+
+/**
+ * tf_channel_set_add_channel:
+ * @set: a #TfChannelSet
+ * @channel: a #TfChannel
+ *
+ * Adds @channel to @set, the messages from its current and future
+ * conferences will be given to it. The set keeps a reference to the
+ * channel until it is removed with tf_channel_set_remove_channel().
+ *
+ * Since: 0.6.3
+ */
+
+void
+tf_channel_set_add_channel (TfChannelSet *set,
+    TfChannel *channel)
+{
+  GPtrArray *conferences = NULL;
+  guint i;
+
+  g_return_if_fail (TF_IS_CHANNEL_SET (set));
+  g_return_if_fail (TF_IS_CHANNEL (channel));
+
+  if (g_hash_table_lookup (set->channels, channel))
+    return;
+
+  g_hash_table_insert (set->channels, channel, g_object_ref (channel));
+
+  g_signal_connect (channel, "fs-conference-added",
+      G_CALLBACK (channel_fs_conference_added), set);
+  g_signal_connect (channel, "fs-conference-removed",
+      G_CALLBACK (channel_fs_conference_removed), set);
+
+  g_object_get (channel, "fs-conferences", &conferences, NULL);
+
+  if (conferences == NULL)
+    return;
+
+  for (i = 0; i < conferences->len; i++)
+    channel_fs_conference_added (channel,
+        g_ptr_array_index (conferences, i), set);
+
+  g_ptr_array_unref (conferences);
+}
+
+static gboolean
+remove_channel_conference (gpointer key, gpointer value, gpointer user_data)
+{
+  return value == user_data;
+}
+
+/**
+ * tf_channel_set_remove_channel:
+ * @set: a #TfChannelSet
+ * @channel: a #TfChannel
+ *
+ * Removes @channel from @set, and drops the reference the set had on it.
+ *
+ * Since: 0.6.3
+ */
+
+void
+tf_channel_set_remove_channel (TfChannelSet *set,
+    TfChannel *channel)
+{
+  g_return_if_fail (TF_IS_CHANNEL_SET (set));
+  g_return_if_fail (TF_IS_CHANNEL (channel));
+
+  if (!g_hash_table_lookup (set->channels, channel))
+    return;
+
+  g_hash_table_foreach_remove (set->conferences, remove_channel_conference,
+      channel);
+  disconnect_channel (channel, channel, set);
+  g_hash_table_remove (set->channels, channel);
+}
+
+/**
+ * tf_channel_set_bus_message:
+ * @set: a #TfChannelSet
+ * @message: A #GstMessage received from the bus
+ *
+ * Hands @message to the channel of @set owning the conference that posted
+ * it, if any. This is only needed if the set was created without a bus.
+ * #GstMessages are not modified.
+ *
+ * Returns: %TRUE if the message has been handled, %FALSE otherwise
+ *
+ * Since: 0.6.3
+ */
+
+gboolean
+tf_channel_set_bus_message (TfChannelSet *set,
+    GstMessage *message)
+{
+  TfChannel *channel;
+
+  g_return_val_if_fail (TF_IS_CHANNEL_SET (set), FALSE);
+  g_return_val_if_fail (message != NULL, FALSE);
+
+  if (GST_MESSAGE_SRC (message) == NULL)
+    return FALSE;
+
+  channel = g_hash_table_lookup (set->conferences, GST_MESSAGE_SRC (message));
+  if (channel == NULL)
+    return FALSE;
+
+  return tf_channel_bus_message (channel, message);
+}
@@ -0,0 +1,62 @@
+#ifndef __TF_CHANNEL_SET_H__
+#define __TF_CHANNEL_SET_H__
+
+#include <glib-object.h>
+#include <gst/gst.h>
+#include <telepathy-farstream/channel.h>
+
+G_BEGIN_DECLS
+
+#define TF_TYPE_CHANNEL_SET tf_channel_set_get_type()
+
+#define TF_CHANNEL_SET(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+  TF_TYPE_CHANNEL_SET, TfChannelSet))
+
+#define TF_CHANNEL_SET_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), \
+  TF_TYPE_CHANNEL_SET, TfChannelSetClass))
+
+#define TF_IS_CHANNEL_SET(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TF_TYPE_CHANNEL_SET))
+
+#define TF_IS_CHANNEL_SET_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), TF_TYPE_CHANNEL_SET))
+
+#define TF_CHANNEL_SET_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+  TF_TYPE_CHANNEL_SET, TfChannelSetClass))
+
+/**
+ * TfChannelSet:
+ *
+ * All members of the object are private
+ */
+
+typedef struct _TfChannelSet TfChannelSet;
+
+/**
+ * TfChannelSetClass:
+ * @parent_class: the parent #GObjectClass
+ *
+ * There are no overridable functions
+ */
+
+typedef struct _TfChannelSetClass TfChannelSetClass;
+
+GType tf_channel_set_get_type (void);
+
+TfChannelSet *tf_channel_set_new (GstBus *bus);
+
+void tf_channel_set_add_channel (TfChannelSet *set,
+    TfChannel *channel);
+
+void tf_channel_set_remove_channel (TfChannelSet *set,
+    TfChannel *channel);
+
+gboolean tf_channel_set_bus_message (TfChannelSet *set,
+    GstMessage *message);
+
+G_END_DECLS
+
+#endif /* __TF_CHANNEL_SET_H__ */
@@ -27,6 +27,14 @@
  * org.freedesktop.Telepathy.Channel.Interface.MediaSignalling on a
  * channel using Farstream or the media part of the
  * org.freedesktop.Telepathy.Channel.Type.Call that has HardwareStreaming=FALSE
+ *
+ * The Farstream transmitters only take relay servers as IP addresses. The
+ * relay servers that a Call connection manager gives by name are resolved
+ * in the background as soon as a stream knows them, and the addresses are
+ * kept for the whole process. A relay whose name could not be resolved, or
+ * was not resolved yet, when the stream's #FsStream is created is not used.
+ * See #TfChannel:pre-gather-candidates for the only case where the stream
+ * waits for the resolution.
  */
 
 #include "config.h"
@@ -45,6 +53,9 @@
 #include "media-signalling-content.h"
 #include "call-channel.h"
 #include "content.h"
+#include "conference-pool.h"
+#include "codec-cache.h"
+#include "utils.h"
 
 
 static void channel_async_initable_init (GAsyncInitableIface *asynciface);
@@ -64,6 +75,25 @@ struct _TfChannelPrivate
   gulong channel_invalidated_handler;
 
   gboolean closed;
+
+  GMainContext *context;
+  gboolean speculative_sessions;
+  gboolean early_media;
+  guint candidate_batch_delay;
+  gboolean pre_gather_candidates;
+  gboolean shared_media_description;
+
+  /* Set of the FsConferences of this channel, used from streaming threads by
+   * the sync bus handler, the mutex also protects the sync messages */
+  GMutex conferences_mutex;
+  GHashTable *conferences;
+
+  GstBus *sync_bus;
+  gulong sync_message_handler;
+  /* Messages taken by the sync handler, in the order they were posted,
+   * waiting for sync_source to dispatch them in the channel's context */
+  GQueue sync_messages;
+  GSource *sync_source;
 };
 
 enum
@@ -82,6 +112,12 @@ enum
 {
   PROP_CHANNEL = 1,
   PROP_OBJECT_PATH,
+  PROP_MAIN_CONTEXT,
+  PROP_SPECULATIVE_SESSIONS,
+  PROP_EARLY_MEDIA,
+  PROP_CANDIDATE_BATCH_DELAY,
+  PROP_PRE_GATHER_CANDIDATES,
+  PROP_SHARED_MEDIA_DESCRIPTION,
   PROP_FS_CONFERENCES
 };
 
@@ -116,6 +152,9 @@ tf_channel_init (TfChannel *self)
       TF_TYPE_CHANNEL, TfChannelPrivate);
 
   self->priv = priv;
+
+  g_mutex_init (&priv->conferences_mutex);
+  priv->conferences = g_hash_table_new (g_direct_hash, g_direct_equal);
 }
 
 static void
@@ -143,6 +182,24 @@ tf_channel_get_property (GObject    *object,
       g_value_set_string (value,
           tp_proxy_get_object_path (self->priv->channel_proxy));
       break;
+    case PROP_MAIN_CONTEXT:
+      g_value_set_boxed (value, self->priv->context);
+      break;
+    case PROP_SPECULATIVE_SESSIONS:
+      g_value_set_boolean (value, self->priv->speculative_sessions);
+      break;
+    case PROP_EARLY_MEDIA:
+      g_value_set_boolean (value, self->priv->early_media);
+      break;
+    case PROP_CANDIDATE_BATCH_DELAY:
+      g_value_set_uint (value, self->priv->candidate_batch_delay);
+      break;
+    case PROP_PRE_GATHER_CANDIDATES:
+      g_value_set_boolean (value, self->priv->pre_gather_candidates);
+      break;
+    case PROP_SHARED_MEDIA_DESCRIPTION:
+      g_value_set_boolean (value, self->priv->shared_media_description);
+      break;
     case PROP_FS_CONFERENCES:
       if (self->priv->call_channel)
         {
@@ -182,6 +239,27 @@ tf_channel_set_property (GObject      *object,
     case PROP_CHANNEL:
       self->priv->channel_proxy = TP_CHANNEL (g_value_dup_object (value));
       break;
+    case PROP_MAIN_CONTEXT:
+      if (g_value_get_boxed (value) != NULL)
+        self->priv->context = g_main_context_ref (g_value_get_boxed (value));
+      else
+        self->priv->context = g_main_context_ref_thread_default ();
+      break;
+    case PROP_SPECULATIVE_SESSIONS:
+      self->priv->speculative_sessions = g_value_get_boolean (value);
+      break;
+    case PROP_EARLY_MEDIA:
+      self->priv->early_media = g_value_get_boolean (value);
+      break;
+    case PROP_CANDIDATE_BATCH_DELAY:
+      self->priv->candidate_batch_delay = g_value_get_uint (value);
+      break;
+    case PROP_PRE_GATHER_CANDIDATES:
+      self->priv->pre_gather_candidates = g_value_get_boolean (value);
+      break;
+    case PROP_SHARED_MEDIA_DESCRIPTION:
+      self->priv->shared_media_description = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -249,6 +327,10 @@ static void
 channel_session_invalidated (TfMediaSignallingChannel *media_signalling_channel,
     FsConference *fsconference, FsParticipant *part, TfChannel *self)
 {
+  g_mutex_lock (&self->priv->conferences_mutex);
+  g_hash_table_remove (self->priv->conferences, fsconference);
+  g_mutex_unlock (&self->priv->conferences_mutex);
+
   g_object_notify (G_OBJECT (self), "fs-conferences");
   g_signal_emit (self, signals[SIGNAL_FS_CONFERENCE_REMOVED], 0,
       fsconference);
@@ -319,7 +401,8 @@ channel_prepared (GObject *obj,
         TP_IFACE_QUARK_CHANNEL_INTERFACE_MEDIA_SIGNALLING))
     {
       self->priv->media_signalling_channel =
-          tf_media_signalling_channel_new (channel_proxy);
+          tf_media_signalling_channel_new (channel_proxy,
+              self->priv->context);
 
       self->priv->media_signalling_contents = g_hash_table_new_full (
           g_direct_hash, g_direct_equal, g_object_unref, g_object_unref);
@@ -349,7 +432,8 @@ channel_prepared (GObject *obj,
         }
       else
         {
-          tf_call_channel_new_async (channel_proxy, call_channel_ready, res);
+          tf_call_channel_new_async (channel_proxy, self,
+              call_channel_ready, res);
 
           self->priv->channel_invalidated_handler = g_signal_connect (
               self->priv->channel_proxy,
@@ -386,6 +470,7 @@ tf_channel_init_async (GAsyncInitable *initable,
 {
   TfChannel *self = TF_CHANNEL (initable);
   GSimpleAsyncResult *res;
+  gboolean pushed;
 
   if (cancellable != NULL)
     {
@@ -395,10 +480,15 @@ tf_channel_init_async (GAsyncInitable *initable,
       return;
     }
 
+  /* Everything created from here on completes in the channel's context */
+  pushed = push_thread_default_context (self->priv->context);
+
   res = g_simple_async_result_new (G_OBJECT (self), callback, user_data,
       tf_channel_init_async);
   tp_proxy_prepare_async (self->priv->channel_proxy, NULL,
       channel_prepared, res);
+
+  pop_thread_default_context (self->priv->context, pushed);
 }
 
 static gboolean
@@ -425,6 +515,7 @@ tf_channel_dispose (GObject *object)
 
   g_debug (G_STRFUNC);
 
+  tf_channel_set_sync_bus (self, NULL);
 
   if (self->priv->media_signalling_contents != NULL)
     {
@@ -452,6 +543,21 @@ tf_channel_dispose (GObject *object)
     G_OBJECT_CLASS (tf_channel_parent_class)->dispose (object);
 }
 
+static void
+tf_channel_finalize (GObject *object)
+{
+  TfChannel *self = TF_CHANNEL (object);
+
+  g_hash_table_unref (self->priv->conferences);
+  g_mutex_clear (&self->priv->conferences_mutex);
+
+  if (self->priv->context != NULL)
+    g_main_context_unref (self->priv->context);
+
+  if (G_OBJECT_CLASS (tf_channel_parent_class)->finalize)
+    G_OBJECT_CLASS (tf_channel_parent_class)->finalize (object);
+}
+
 static void
 tf_channel_class_init (TfChannelClass *klass)
 {
@@ -463,6 +569,7 @@ tf_channel_class_init (TfChannelClass *klass)
   object_class->get_property = tf_channel_get_property;
 
   object_class->dispose = tf_channel_dispose;
+  object_class->finalize = tf_channel_finalize;
 
   g_object_class_install_property (object_class, PROP_CHANNEL,
       g_param_spec_object ("channel",
@@ -479,6 +586,129 @@ tf_channel_class_init (TfChannelClass *klass)
           NULL,
           G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * TfChannel:main-context:
+   *
+   * The #GMainContext in which the channel's async results, idle and
+   * timeout sources are dispatched, the thread-default context of the
+   * thread creating the channel if %NULL. It can only be set at
+   * construction, see tf_channel_new_with_context_async().
+   *
+   * The channel must only be used from the thread running @context, and
+   * so D-Bus replies and signals, which are dispatched by the
+   * #DBusGConnection of the channel proxy, must be too: the #TpChannel
+   * has to come from a private connection attached to that context with
+   * dbus_connection_setup_with_g_main() unless it is the default context.
+   *
+   * Since: 0.6.3
+   */
+
+  g_object_class_install_property (object_class, PROP_MAIN_CONTEXT,
+      g_param_spec_boxed ("main-context",
+          "GMainContext",
+          "The GMainContext the channel's sources and results run in",
+          G_TYPE_MAIN_CONTEXT,
+          G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * TfChannel:speculative-sessions:
+   *
+   * If %TRUE, the #FsSession of each Call content is created as soon as
+   * the content appears, assuming RTP, so that the local codecs are
+   * discovered while the rest of the content's properties are being
+   * retrieved. It is replaced if the content turns out not to be RTP.
+   *
+   * Since: 0.6.3
+   */
+
+  g_object_class_install_property (object_class, PROP_SPECULATIVE_SESSIONS,
+      g_param_spec_boolean ("speculative-sessions",
+          "Speculative sessions",
+          "Create the FsSessions before knowing the contents' packetization",
+          FALSE,
+          G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * TfChannel:early-media:
+   *
+   * If %TRUE, each Call stream starts sending as soon as the remote codecs
+   * have been set and a candidate pair is active, without waiting for the
+   * connection manager to ask for it. The stream follows the connection
+   * manager again from its first sending state change.
+   *
+   * Since: 0.6.3
+   */
+
+  g_object_class_install_property (object_class, PROP_EARLY_MEDIA,
+      g_param_spec_boolean ("early-media",
+          "Early media",
+          "Start sending before the connection manager asks for it",
+          FALSE,
+          G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * TfChannel:candidate-batch-delay:
+   *
+   * How long, in milliseconds, the local candidates of a Call stream are
+   * collected before being given to the connection manager in a single
+   * call. They are also sent when the initial candidates are all known, or
+   * when enough of them have been collected. 0 sends each candidate as
+   * soon as it is found, %G_MAXUINT holds the initial candidates until
+   * they are all known.
+   *
+   * Since: 0.6.3
+   */
+
+  g_object_class_install_property (object_class, PROP_CANDIDATE_BATCH_DELAY,
+      g_param_spec_uint ("candidate-batch-delay",
+          "Candidate batch delay",
+          "How long to collect local candidates before sending them (ms)",
+          0, G_MAXUINT, 0,
+          G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * TfChannel:pre-gather-candidates:
+   *
+   * If %TRUE, the #FsStream of each Call stream is created, and so starts
+   * gathering its local candidates, as soon as both the stream's STUN and
+   * relay server lists have been received, even if they are empty, instead
+   * of waiting for the connection manager to say it has retrieved all of
+   * the server information. Gathering then happens while the call is
+   * ringing. Servers changed after that point are not used by the stream.
+   * Relays given by name are still waited for until they are resolved, for
+   * a short while.
+   *
+   * Since: 0.6.3
+   */
+
+  g_object_class_install_property (object_class, PROP_PRE_GATHER_CANDIDATES,
+      g_param_spec_boolean ("pre-gather-candidates",
+          "Pre-gather candidates",
+          "Start gathering candidates before all the server info is known",
+          FALSE,
+          G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * TfChannel:shared-media-description:
+   *
+   * If %TRUE, when the local media description of a Call content is the
+   * same for several remote contacts, it is given to the connection manager
+   * once, with the RemoteContact key set to 0, instead of once per contact.
+   * This is not part of the Telepathy specification, so it should only be
+   * enabled with connection managers known to accept it. If the connection
+   * manager refuses it as not implemented or invalid, the content goes back
+   * to one update per contact.
+   *
+   * Since: 0.6.3
+   */
+
+  g_object_class_install_property (object_class,
+      PROP_SHARED_MEDIA_DESCRIPTION,
+      g_param_spec_boolean ("shared-media-description",
+          "Shared media description",
+          "Send one local media description for all contacts",
+          FALSE,
+          G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   g_object_class_install_property (object_class, PROP_FS_CONFERENCES,
       g_param_spec_boxed ("fs-conferences",
@@ -614,6 +844,26 @@ channel_invalidated (TpChannel *channel_proxy,
  *
  * The user must call tf_channel_new_finish() in the callback
  * to get the finished object.
+ *
+ * The channel runs in the thread-default #GMainContext of the caller, to
+ * use another one, see tf_channel_new_with_context_async().
+ *
+ * The optional behaviours of the channel are construct-only properties,
+ * to enable them, create the channel with g_async_initable_new_async()
+ * instead, and still get it with tf_channel_new_finish():
+ *
+ * |[
+ * g_async_initable_new_async (TF_TYPE_CHANNEL, G_PRIORITY_DEFAULT, NULL,
+ *     channel_ready_cb, user_data,
+ *     "channel", channel_proxy,
+ *     "main-context", context,
+ *     "speculative-sessions", TRUE,
+ *     "early-media", TRUE,
+ *     "candidate-batch-delay", 20,
+ *     "pre-gather-candidates", TRUE,
+ *     "shared-media-description", FALSE,
+ *     NULL);
+ * ]|
  */
 
 void
@@ -621,13 +871,78 @@ tf_channel_new_async (TpChannel *channel_proxy,
     GAsyncReadyCallback callback,
     gpointer user_data)
 {
+  tf_channel_new_with_context_async (channel_proxy, NULL, callback,
+      user_data);
+}
+
+/**
+ * tf_channel_new_with_context_async:
+ * @channel_proxy: a #TpChannel proxy
+ * @context: (allow-none): the #GMainContext the channel runs in, or %NULL
+ *  for the thread-default context of the caller
+ * @callback: a #GAsyncReadyCallback to call when the channel is ready
+ * @user_data: the data to pass to callback function
+ *
+ * Like tf_channel_new_async(), but the async results, idle and timeout
+ * sources of the new channel and of all its contents and streams are
+ * dispatched in @context, which is also where @callback is called. This
+ * allows spreading many channels over several threads, each running its
+ * own #GMainLoop.
+ *
+ * This must be called from the thread running @context, or before any
+ * thread runs it, and the channel must only be used from that thread
+ * afterwards, see #TfChannel:main-context.
+ *
+ * Since: 0.6.3
+ */
+
+void
+tf_channel_new_with_context_async (TpChannel *channel_proxy,
+    GMainContext *context,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  gboolean pushed;
+
   g_return_if_fail (channel_proxy != NULL);
   g_return_if_fail (callback != NULL);
 
-  return g_async_initable_new_async (TF_TYPE_CHANNEL,
+  /* So that a construction error is reported in @context too */
+  pushed = push_thread_default_context (context);
+  g_return_if_fail (context == NULL || pushed);
+
+  g_async_initable_new_async (TF_TYPE_CHANNEL,
       0, NULL, callback, user_data,
       "channel", channel_proxy,
+      "main-context", context,
       NULL);
+
+  pop_thread_default_context (context, pushed);
+}
+
+static gboolean
+dispatch_bus_message (TfChannel *channel,
+    GstMessage *message)
+{
+  if (channel->priv->media_signalling_channel)
+    return tf_media_signalling_channel_bus_message (
+        channel->priv->media_signalling_channel, message);
+  else if (channel->priv->call_channel)
+    return tf_call_channel_bus_message (channel->priv->call_channel,
+      message);
+
+  return FALSE;
+}
+
+static GQuark
+sync_dispatch_quark (void)
+{
+  static GQuark quark = 0;
+
+  if (G_UNLIKELY (quark == 0))
+    quark = g_quark_from_static_string ("tf-channel-sync-dispatch");
+
+  return quark;
 }
 
 /**
@@ -648,20 +963,144 @@ tf_channel_bus_message (TfChannel *channel,
   g_return_val_if_fail (channel != NULL, FALSE);
   g_return_val_if_fail (message != NULL, FALSE);
 
-  if (channel->priv->media_signalling_channel)
-    return tf_media_signalling_channel_bus_message (
-        channel->priv->media_signalling_channel, message);
-  else if (channel->priv->call_channel)
-    return tf_call_channel_bus_message (channel->priv->call_channel,
-      message);
+  /* Already picked up by the sync handler, which will take care of it */
+  if (gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (message),
+          sync_dispatch_quark ()) == channel)
+    return TRUE;
+
+  return dispatch_bus_message (channel, message);
+}
+
+static gboolean
+sync_dispatch_cb (gpointer user_data)
+{
+  TfChannel *self = user_data;
+  GQueue messages;
+  GstMessage *message;
+
+  g_mutex_lock (&self->priv->conferences_mutex);
+  messages = self->priv->sync_messages;
+  g_queue_init (&self->priv->sync_messages);
+  g_source_unref (self->priv->sync_source);
+  self->priv->sync_source = NULL;
+  g_mutex_unlock (&self->priv->conferences_mutex);
+
+  while ((message = g_queue_pop_head (&messages)) != NULL)
+    {
+      if (!self->priv->closed)
+        dispatch_bus_message (self, message);
+      gst_message_unref (message);
+    }
 
   return FALSE;
 }
 
+/* Called from the streaming thread that posted the message. The errors
+ * and warnings of the conferences are taken too, so that all the messages
+ * of the channel are handled in the order they were posted */
+static void
+sync_bus_message (GstBus *bus, GstMessage *message, TfChannel *self)
+{
+  const GstStructure *s;
+
+  switch (GST_MESSAGE_TYPE (message))
+    {
+    case GST_MESSAGE_ELEMENT:
+      s = gst_message_get_structure (message);
+      if (s == NULL || !g_str_has_prefix (gst_structure_get_name (s),
+              "farstream-"))
+        return;
+      break;
+    case GST_MESSAGE_ERROR:
+    case GST_MESSAGE_WARNING:
+      break;
+    default:
+      return;
+    }
+
+  g_mutex_lock (&self->priv->conferences_mutex);
+
+  if (g_hash_table_lookup (self->priv->conferences,
+          GST_MESSAGE_SRC (message)) != NULL)
+    {
+      gst_mini_object_set_qdata (GST_MINI_OBJECT_CAST (message),
+          sync_dispatch_quark (), self, NULL);
+      g_queue_push_tail (&self->priv->sync_messages,
+          gst_message_ref (message));
+
+      if (self->priv->sync_source == NULL)
+        {
+          self->priv->sync_source = g_idle_source_new ();
+          g_source_set_priority (self->priv->sync_source, G_PRIORITY_HIGH);
+          g_source_set_callback (self->priv->sync_source, sync_dispatch_cb,
+              g_object_ref (self), g_object_unref);
+          g_source_attach (self->priv->sync_source, self->priv->context);
+        }
+    }
+
+  g_mutex_unlock (&self->priv->conferences_mutex);
+}
+
+/**
+ * tf_channel_set_sync_bus:
+ * @channel: A #TfChannel
+ * @bus: (allow-none): the #GstBus of the pipeline the conferences of this
+ *  channel are in, or %NULL to stop using it
+ *
+ * Makes the channel watch the Farstream element messages synchronously
+ * as they are posted on @bus, instead of waiting for the application to
+ * pass them to tf_channel_bus_message() from its async bus watch. Only
+ * the matching of the message against this channel's conferences is
+ * done in the streaming thread, the messages are then handled in the
+ * channel's #GMainContext ahead of the default priority sources. The
+ * errors and warnings of the conferences are taken the same way, so all
+ * the messages of the channel are still handled in the order they were
+ * posted.
+ *
+ * The application must still call tf_channel_bus_message() on the
+ * messages from its async bus watch, messages already taken care of by
+ * the sync handler will just return %TRUE.
+ *
+ * Since: 0.6.3
+ */
+
+void
+tf_channel_set_sync_bus (TfChannel *channel,
+    GstBus *bus)
+{
+  g_return_if_fail (TF_IS_CHANNEL (channel));
+  g_return_if_fail (bus == NULL || GST_IS_BUS (bus));
+
+  if (channel->priv->sync_bus == bus)
+    return;
+
+  if (channel->priv->sync_bus)
+    {
+      g_signal_handler_disconnect (channel->priv->sync_bus,
+          channel->priv->sync_message_handler);
+      gst_bus_disable_sync_message_emission (channel->priv->sync_bus);
+      gst_object_unref (channel->priv->sync_bus);
+      channel->priv->sync_bus = NULL;
+      channel->priv->sync_message_handler = 0;
+    }
+
+  if (bus == NULL)
+    return;
+
+  channel->priv->sync_bus = gst_object_ref (bus);
+  gst_bus_enable_sync_message_emission (bus);
+  channel->priv->sync_message_handler = g_signal_connect (bus,
+      "sync-message", G_CALLBACK (sync_bus_message), channel);
+}
+
 static void
 channel_fs_conference_added (GObject *proxy, FsConference *conf,
     TfChannel *self)
 {
+  g_mutex_lock (&self->priv->conferences_mutex);
+  g_hash_table_insert (self->priv->conferences, conf, conf);
+  g_mutex_unlock (&self->priv->conferences_mutex);
+
   g_object_notify (G_OBJECT (self), "fs-conferences");
   g_signal_emit (self, signals[SIGNAL_FS_CONFERENCE_ADDED], 0,
       conf);
@@ -671,6 +1110,10 @@ static void
 channel_fs_conference_removed (GObject *proxy, FsConference *conf,
     TfChannel *self)
 {
+  g_mutex_lock (&self->priv->conferences_mutex);
+  g_hash_table_remove (self->priv->conferences, conf);
+  g_mutex_unlock (&self->priv->conferences_mutex);
+
   g_object_notify (G_OBJECT (self), "fs-conferences");
   g_signal_emit (self, signals[SIGNAL_FS_CONFERENCE_REMOVED], 0,
       conf);
@@ -708,3 +1151,48 @@ tf_channel_new_finish (GObject *object,
   return (TfChannel *) g_async_initable_new_finish (G_ASYNC_INITABLE (object),
       result, error);
 }
+
+/**
+ * tf_channel_preallocate_conferences:
+ * @conference_type: the type of conference, like "rtp"
+ * @count: how many conferences to keep ready, 0 to stop
+ *
+ * Makes the channels created in this process take their #FsConference
+ * from a pool of @count pre-instantiated conferences of the given type,
+ * instead of creating it when the call is being set up. The pool is
+ * refilled in a background thread as conferences are taken from it.
+ *
+ * Since: 0.6.3
+ */
+
+void
+tf_channel_preallocate_conferences (const gchar *conference_type,
+    guint count)
+{
+  g_return_if_fail (conference_type != NULL);
+
+  _tf_conference_pool_set_size (conference_type, count);
+}
+
+/**
+ * tf_channel_enable_codec_cache:
+ * @directory: (allow-none): the directory to keep the cache in, or %NULL to
+ *  disable it
+ *
+ * Makes the channels created in this process remember the complete local
+ * codecs, including their configuration parameters, for each media type
+ * and conference type in @directory. Later calls can then describe their
+ * media as soon as the session starts, instead of waiting for the codec
+ * configuration to be discovered. The description is updated if the
+ * discovered codecs turn out to be different from the cached ones.
+ *
+ * The cache is disabled by default.
+ *
+ * Since: 0.6.3
+ */
+
+void
+tf_channel_enable_codec_cache (const gchar *directory)
+{
+  _tf_codec_cache_set_directory (directory);
+}
@@ -52,6 +52,11 @@ void tf_channel_new_async (TpChannel *channel_proxy,
     GAsyncReadyCallback callback,
     gpointer user_data);
 
+void tf_channel_new_with_context_async (TpChannel *channel_proxy,
+    GMainContext *context,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+
 TfChannel *tf_channel_new_finish (GObject *object,
     GAsyncResult *result,
     GError **error);
@@ -60,6 +65,14 @@ TfChannel *tf_channel_new_finish (GObject *object,
 gboolean tf_channel_bus_message (TfChannel *channel,
     GstMessage *message);
 
+void tf_channel_set_sync_bus (TfChannel *channel,
+    GstBus *bus);
+
+void tf_channel_preallocate_conferences (const gchar *conference_type,
+    guint count);
+
+void tf_channel_enable_codec_cache (const gchar *directory);
+
 G_END_DECLS
 
 #endif /* __TF_CHANNEL_H__ */
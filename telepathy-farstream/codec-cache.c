@@ -0,0 +1,337 @@
+/*
+ * codec-cache.c - On-disk cache of the discovered local codecs
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Getting the configuration of some codecs (like the Theora headers or the
+ * H.264 sprop-parameter-sets) requires running the encoders, so the
+ * complete local codecs are only known some time after the session starts.
+ * The last complete list for each media type and conference type is kept
+ * in a key file, one group per codec, so that the next call can describe
+ * its media right away.
+ */
+
+#include "config.h"
+
+#include "codec-cache.h"
+
+#include <errno.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "debug.h"
+
+#define PARAM_PREFIX "param:"
+#define FEEDBACK_PREFIX "feedback:"
+
+G_LOCK_DEFINE_STATIC (cache);
+static gchar *cache_directory = NULL;
+/* "media/conference" -> GList of FsCodecs, or NULL if it was read from the
+ * disk and there was nothing usable there */
+static GHashTable *entries = NULL;
+
+void
+_tf_codec_cache_set_directory (const gchar *directory)
+{
+  G_LOCK (cache);
+
+  g_free (cache_directory);
+  cache_directory = g_strdup (directory);
+
+  if (entries)
+    g_hash_table_unref (entries);
+  entries = NULL;
+
+  if (cache_directory)
+    entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        (GDestroyNotify) fs_codec_list_destroy);
+
+  G_UNLOCK (cache);
+}
+
+gboolean
+_tf_codec_cache_is_enabled (void)
+{
+  gboolean enabled;
+
+  G_LOCK (cache);
+  enabled = (cache_directory != NULL);
+  G_UNLOCK (cache);
+
+  return enabled;
+}
+
+/* Called with the lock held */
+static gchar *
+entry_filename (const gchar *key)
+{
+  gchar *basename, *filename;
+
+  basename = g_strdup_printf ("%s.codecs", key);
+  g_strdelimit (basename, "/", '-');
+  filename = g_build_filename (cache_directory, basename, NULL);
+  g_free (basename);
+
+  return filename;
+}
+
+static FsCodec *
+codec_from_group (GKeyFile *keyfile, const gchar *group,
+    FsMediaType media_type)
+{
+  FsCodec *codec;
+  gchar *encoding_name;
+  gchar **keys;
+  GError *error = NULL;
+  gint id;
+  guint i;
+
+  encoding_name = g_key_file_get_string (keyfile, group, "encoding-name",
+      NULL);
+  id = g_key_file_get_integer (keyfile, group, "id", &error);
+  if (encoding_name == NULL || error != NULL)
+    {
+      g_clear_error (&error);
+      g_free (encoding_name);
+      return NULL;
+    }
+
+  codec = fs_codec_new (id, encoding_name, media_type,
+      g_key_file_get_integer (keyfile, group, "clock-rate", NULL));
+  g_free (encoding_name);
+
+  codec->channels = g_key_file_get_integer (keyfile, group, "channels", NULL);
+  if (g_key_file_has_key (keyfile, group, "trr-int", NULL))
+    codec->minimum_reporting_interval = g_key_file_get_integer (keyfile,
+        group, "trr-int", NULL);
+
+  keys = g_key_file_get_keys (keyfile, group, NULL, NULL);
+
+  for (i = 0; keys && keys[i]; i++)
+    {
+      gchar *value;
+
+      value = g_key_file_get_string (keyfile, group, keys[i], NULL);
+      if (value == NULL)
+        continue;
+
+      if (g_str_has_prefix (keys[i], PARAM_PREFIX))
+        {
+          fs_codec_add_optional_parameter (codec,
+              keys[i] + strlen (PARAM_PREFIX), value);
+        }
+      else if (g_str_has_prefix (keys[i], FEEDBACK_PREFIX))
+        {
+          gchar **type = g_strsplit (keys[i] + strlen (FEEDBACK_PREFIX),
+              "/", 2);
+
+          fs_codec_add_feedback_parameter (codec, type[0],
+              type[1] ? type[1] : "", value);
+          g_strfreev (type);
+        }
+
+      g_free (value);
+    }
+
+  g_strfreev (keys);
+
+  return codec;
+}
+
+/* Called with the lock held */
+static GList *
+read_entry (const gchar *key, FsMediaType media_type)
+{
+  GKeyFile *keyfile = g_key_file_new ();
+  GQueue codecs = G_QUEUE_INIT;
+  gchar *filename;
+  gchar **groups;
+  GError *error = NULL;
+  guint i;
+
+  filename = entry_filename (key);
+
+  if (!g_key_file_load_from_file (keyfile, filename, G_KEY_FILE_NONE, &error))
+    {
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        g_warning ("Could not read codec cache %s: %s", filename,
+            error->message);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  groups = g_key_file_get_groups (keyfile, NULL);
+
+  for (i = 0; groups[i]; i++)
+    {
+      FsCodec *codec = codec_from_group (keyfile, groups[i], media_type);
+
+      if (codec == NULL)
+        {
+          g_warning ("Ignoring invalid codec cache %s", filename);
+          fs_codec_list_destroy (codecs.head);
+          g_queue_init (&codecs);
+          break;
+        }
+
+      g_queue_push_tail (&codecs, codec);
+    }
+
+  g_strfreev (groups);
+
+ out:
+  g_key_file_free (keyfile);
+  g_free (filename);
+
+  return codecs.head;
+}
+
+/* Called with the lock held */
+static void
+write_entry (const gchar *key, GList *codecs)
+{
+  GKeyFile *keyfile = g_key_file_new ();
+  GList *item;
+  gchar *filename;
+  gchar *data;
+  gsize length;
+  GError *error = NULL;
+  guint i = 0;
+
+  for (item = codecs; item; item = item->next, i++)
+    {
+      FsCodec *codec = item->data;
+      GList *item2;
+      gchar *group;
+
+      group = g_strdup_printf ("codec %u", i);
+
+      g_key_file_set_integer (keyfile, group, "id", codec->id);
+      g_key_file_set_string (keyfile, group, "encoding-name",
+          codec->encoding_name);
+      g_key_file_set_integer (keyfile, group, "clock-rate", codec->clock_rate);
+      g_key_file_set_integer (keyfile, group, "channels", codec->channels);
+      if (codec->minimum_reporting_interval != G_MAXUINT)
+        g_key_file_set_integer (keyfile, group, "trr-int",
+            codec->minimum_reporting_interval);
+
+      for (item2 = codec->optional_params; item2; item2 = item2->next)
+        {
+          FsCodecParameter *param = item2->data;
+          gchar *name = g_strconcat (PARAM_PREFIX, param->name, NULL);
+
+          g_key_file_set_string (keyfile, group, name, param->value);
+          g_free (name);
+        }
+
+      for (item2 = codec->feedback_params; item2; item2 = item2->next)
+        {
+          FsFeedbackParameter *fb = item2->data;
+          gchar *name = g_strdup_printf (FEEDBACK_PREFIX "%s/%s", fb->type,
+              fb->subtype);
+
+          g_key_file_set_string (keyfile, group, name, fb->extra_params);
+          g_free (name);
+        }
+
+      g_free (group);
+    }
+
+  data = g_key_file_to_data (keyfile, &length, NULL);
+  filename = entry_filename (key);
+
+  if (g_mkdir_with_parents (cache_directory, 0700) < 0 ||
+      !g_file_set_contents (filename, data, length, &error))
+    {
+      g_warning ("Could not write codec cache %s: %s", filename,
+          error ? error->message : g_strerror (errno));
+      g_clear_error (&error);
+    }
+  else
+    {
+      TF_DEBUG (CODECS, "Wrote codec cache %s", filename);
+    }
+
+  g_free (filename);
+  g_free (data);
+  g_key_file_free (keyfile);
+}
+
+/* Called with the lock held, the returned list belongs to the cache */
+static GList *
+get_entry (const gchar *key, FsMediaType media_type)
+{
+  GList *codecs;
+
+  if (g_hash_table_lookup_extended (entries, key, NULL, (gpointer *) &codecs))
+    return codecs;
+
+  codecs = read_entry (key, media_type);
+  g_hash_table_insert (entries, g_strdup (key), codecs);
+
+  return codecs;
+}
+
+static gchar *
+make_key (FsMediaType media_type, const gchar *conference_type)
+{
+  return g_strdup_printf ("%s/%s", fs_media_type_to_string (media_type),
+      conference_type);
+}
+
+/* Returns a copy of the cached codecs, or NULL if the cache is disabled or
+ * has nothing for these types */
+GList *
+_tf_codec_cache_lookup (FsMediaType media_type, const gchar *conference_type)
+{
+  GList *codecs = NULL;
+  gchar *key;
+
+  key = make_key (media_type, conference_type);
+
+  G_LOCK (cache);
+  if (cache_directory)
+    codecs = fs_codec_list_copy (get_entry (key, media_type));
+  G_UNLOCK (cache);
+
+  g_free (key);
+
+  return codecs;
+}
+
+/* Only touches the disk if @codecs differ from what is cached */
+void
+_tf_codec_cache_store (FsMediaType media_type, const gchar *conference_type,
+    GList *codecs)
+{
+  gchar *key;
+
+  key = make_key (media_type, conference_type);
+
+  G_LOCK (cache);
+  if (cache_directory &&
+      !fs_codec_list_are_equal (get_entry (key, media_type), codecs))
+    {
+      g_hash_table_insert (entries, g_strdup (key),
+          fs_codec_list_copy (codecs));
+      write_entry (key, codecs);
+    }
+  G_UNLOCK (cache);
+
+  g_free (key);
+}
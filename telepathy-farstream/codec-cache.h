@@ -0,0 +1,40 @@
+/*
+ * codec-cache.h - On-disk cache of the discovered local codecs
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TF_CODEC_CACHE_H__
+#define __TF_CODEC_CACHE_H__
+
+#include <glib.h>
+#include <farstream/fs-codec.h>
+
+G_BEGIN_DECLS
+
+void _tf_codec_cache_set_directory (const gchar *directory);
+
+gboolean _tf_codec_cache_is_enabled (void);
+
+GList *_tf_codec_cache_lookup (FsMediaType media_type,
+    const gchar *conference_type);
+
+void _tf_codec_cache_store (FsMediaType media_type,
+    const gchar *conference_type, GList *codecs);
+
+G_END_DECLS
+
+#endif /* __TF_CODEC_CACHE_H__ */
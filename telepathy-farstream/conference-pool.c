@@ -0,0 +1,164 @@
+/*
+ * conference-pool.c - Pre-instantiated FsConferences
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Creating a conference element loads its plugins and builds its rtpbin,
+ * which is a noticeable part of the call setup time. The pools keep a few
+ * of them ready per conference type and refill themselves from a
+ * background thread as they get used.
+ */
+
+#include "config.h"
+
+#include "conference-pool.h"
+
+#include <gst/gst.h>
+
+struct ConferencePool {
+  gchar *conference_type;
+  guint size;
+  GQueue conferences; /* ref-sunk FsConferences */
+  gboolean refilling;
+};
+
+G_LOCK_DEFINE_STATIC (pools);
+/* conference type -> ConferencePool, never freed */
+static GHashTable *pools = NULL;
+static GThreadPool *refill_thread = NULL;
+
+static FsConference *
+make_conference (const gchar *conference_type)
+{
+  GstElement *element;
+  gchar *tmp;
+
+  tmp = g_strdup_printf ("fs%sconference", conference_type);
+  element = gst_element_factory_make (tmp, NULL);
+  g_free (tmp);
+
+  if (element == NULL)
+    return NULL;
+
+  return FS_CONFERENCE (gst_object_ref_sink (element));
+}
+
+static void
+refill_pool (gpointer data, gpointer user_data)
+{
+  struct ConferencePool *pool = data;
+
+  for (;;)
+    {
+      FsConference *conf;
+
+      G_LOCK (pools);
+      if (pool->conferences.length >= pool->size)
+        {
+          pool->refilling = FALSE;
+          G_UNLOCK (pools);
+          return;
+        }
+      G_UNLOCK (pools);
+
+      conf = make_conference (pool->conference_type);
+
+      G_LOCK (pools);
+      if (conf == NULL)
+        {
+          g_warning ("Could not create a fs%sconference for the pool",
+              pool->conference_type);
+          pool->size = 0;
+        }
+      else
+        {
+          g_queue_push_tail (&pool->conferences, conf);
+        }
+      G_UNLOCK (pools);
+    }
+}
+
+/* Called with the pools lock held */
+static void
+schedule_refill (struct ConferencePool *pool)
+{
+  if (pool->refilling || pool->conferences.length >= pool->size)
+    return;
+
+  if (refill_thread == NULL)
+    refill_thread = g_thread_pool_new (refill_pool, NULL, 1, FALSE, NULL);
+
+  pool->refilling = TRUE;
+  g_thread_pool_push (refill_thread, pool, NULL);
+}
+
+void
+_tf_conference_pool_set_size (const gchar *conference_type, guint size)
+{
+  struct ConferencePool *pool;
+  GList *extra = NULL;
+
+  G_LOCK (pools);
+
+  if (pools == NULL)
+    pools = g_hash_table_new (g_str_hash, g_str_equal);
+
+  pool = g_hash_table_lookup (pools, conference_type);
+  if (pool == NULL)
+    {
+      pool = g_slice_new0 (struct ConferencePool);
+      pool->conference_type = g_strdup (conference_type);
+      g_queue_init (&pool->conferences);
+      g_hash_table_insert (pools, pool->conference_type, pool);
+    }
+
+  pool->size = size;
+
+  while (pool->conferences.length > size)
+    extra = g_list_prepend (extra, g_queue_pop_tail (&pool->conferences));
+
+  schedule_refill (pool);
+
+  G_UNLOCK (pools);
+
+  g_list_free_full (extra, gst_object_unref);
+}
+
+/* This always returns a new ref-sunk conference, or NULL if the type is
+ * unknown */
+FsConference *
+_tf_conference_pool_get (const gchar *conference_type)
+{
+  struct ConferencePool *pool = NULL;
+  FsConference *conf = NULL;
+
+  G_LOCK (pools);
+  if (pools != NULL)
+    pool = g_hash_table_lookup (pools, conference_type);
+  if (pool != NULL)
+    {
+      conf = g_queue_pop_head (&pool->conferences);
+      schedule_refill (pool);
+    }
+  G_UNLOCK (pools);
+
+  if (conf == NULL)
+    conf = make_conference (conference_type);
+
+  return conf;
+}
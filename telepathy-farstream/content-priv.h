@@ -5,6 +5,7 @@
 #include <glib-object.h>
 
 #include <farstream/fs-conference.h>
+#include <farstream/fs-element-added-notifier.h>
 
 
 G_BEGIN_DECLS
@@ -13,6 +14,11 @@ struct _TfContent {
   GObject parent;
 
   guint sending_count;
+
+  /* Applies the element properties of the codec profile, watching the
+   * conference the content's session is in */
+  FsElementAddedNotifier *profile_notifier;
+  GstBin *profile_conference;
 };
 
 struct _TfContentClass{
@@ -3,7 +3,11 @@
 #include "content.h"
 #include "content-priv.h"
 
+#include <string.h>
+
+#include <gio/gio.h>
 #include <farstream/fs-conference.h>
+#include <farstream/fs-utils.h>
 
 #include "channel.h"
 
@@ -49,6 +53,8 @@ enum
 
 static guint signals[SIGNAL_COUNT] = {0};
 
+static void tf_content_dispose (GObject *object);
+
 static void
 tf_content_get_property (GObject    *object,
     guint       property_id,
@@ -70,6 +76,7 @@ tf_content_class_init (TfContentClass *klass)
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
   object_class->get_property = tf_content_get_property;
+  object_class->dispose = tf_content_dispose;
 
   g_object_class_install_property (object_class, PROP_TF_CHANNEL,
       g_param_spec_object ("tf-channel",
@@ -241,6 +248,31 @@ tf_content_init (TfContent *self)
 {
 }
 
+static void
+tf_content_clear_profile_notifier (TfContent *self)
+{
+  if (self->profile_notifier)
+    {
+      fs_element_added_notifier_remove (self->profile_notifier,
+          self->profile_conference);
+      g_object_unref (self->profile_notifier);
+      gst_object_unref (self->profile_conference);
+    }
+  self->profile_notifier = NULL;
+  self->profile_conference = NULL;
+}
+
+static void
+tf_content_dispose (GObject *object)
+{
+  TfContent *self = TF_CONTENT (object);
+
+  tf_content_clear_profile_notifier (self);
+
+  if (G_OBJECT_CLASS (tf_content_parent_class)->dispose)
+    G_OBJECT_CLASS (tf_content_parent_class)->dispose (object);
+}
+
 
 gboolean
 _tf_content_start_sending (TfContent *self)
@@ -549,3 +581,294 @@ tf_content_receiving_failed (TfContent *content,
   tf_content_receiving_failed_literal (content, handles, handle_count, message);
   g_free (message);
 }
+
+/* Codecs are written as "ENCODING" or "ENCODING/clock-rate" */
+static void
+add_profile_codecs (GQueue *prefs, GKeyFile *keyfile, const gchar *profile,
+    const gchar *key, FsMediaType media_type, gint id)
+{
+  gchar **codecs;
+  guint i;
+
+  codecs = g_key_file_get_string_list (keyfile, profile, key, NULL, NULL);
+
+  for (i = 0; codecs && codecs[i]; i++)
+    {
+      gchar **parts = g_strsplit (g_strstrip (codecs[i]), "/", 2);
+
+      if (parts[0][0] != '\0')
+        g_queue_push_tail (prefs, fs_codec_new (id, parts[0], media_type,
+                parts[1] ? g_ascii_strtoull (parts[1], NULL, 10) : 0));
+      g_strfreev (parts);
+    }
+
+  g_strfreev (codecs);
+}
+
+struct ProfileProperties {
+  GKeyFile *keyfile; /* element factory -> properties */
+  gchar *send_prefix;
+  gchar *recv_prefix;
+};
+
+static void
+profile_properties_free (gpointer data, GClosure *closure)
+{
+  struct ProfileProperties *pp = data;
+
+  g_key_file_free (pp->keyfile);
+  g_free (pp->send_prefix);
+  g_free (pp->recv_prefix);
+  g_slice_free (struct ProfileProperties, pp);
+}
+
+/* The RTP conference puts the codec elements of a session in bins named
+ * send_<session id>_<pt> and recv_<session id>_<ssrc>_<pt> */
+static gboolean
+profile_element_in_session (struct ProfileProperties *pp,
+    GstElement *element)
+{
+  GstObject *object = gst_object_ref (element);
+  gboolean found = FALSE;
+
+  while (object != NULL && !found)
+    {
+      GstObject *parent;
+      gchar *name = gst_object_get_name (object);
+
+      found = name != NULL && (g_str_has_prefix (name, pp->send_prefix) ||
+          g_str_has_prefix (name, pp->recv_prefix));
+      g_free (name);
+
+      parent = gst_object_get_parent (object);
+      gst_object_unref (object);
+      object = parent;
+    }
+
+  if (object)
+    gst_object_unref (object);
+
+  return found;
+}
+
+/* Called from streaming threads too */
+static void
+profile_element_added (FsElementAddedNotifier *notifier,
+    GstBin *bin,
+    GstElement *element,
+    gpointer user_data)
+{
+  struct ProfileProperties *pp = user_data;
+  GstElementFactory *factory;
+  const gchar *factory_name;
+  gchar **keys;
+  guint i;
+
+  factory = gst_element_get_factory (element);
+  if (factory == NULL)
+    return;
+
+  factory_name = gst_plugin_feature_get_name (GST_PLUGIN_FEATURE (factory));
+  if (!g_key_file_has_group (pp->keyfile, factory_name) ||
+      !profile_element_in_session (pp, element))
+    return;
+
+  keys = g_key_file_get_keys (pp->keyfile, factory_name, NULL, NULL);
+  for (i = 0; keys && keys[i]; i++)
+    {
+      gchar *value;
+
+      if (!g_object_class_find_property (G_OBJECT_GET_CLASS (element),
+              keys[i]))
+        continue;
+
+      value = g_key_file_get_value (pp->keyfile, factory_name, keys[i], NULL);
+      gst_util_set_object_arg (G_OBJECT (element), keys[i], value);
+      g_free (value);
+    }
+  g_strfreev (keys);
+}
+
+static gboolean
+codec_in_prefs (GQueue *prefs, FsCodec *codec)
+{
+  GList *item;
+
+  for (item = prefs->head; item; item = item->next)
+    {
+      FsCodec *pref = item->data;
+
+      if (!g_ascii_strcasecmp (pref->encoding_name, codec->encoding_name) &&
+          (pref->clock_rate == 0 || pref->clock_rate == codec->clock_rate))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/**
+ * tf_content_set_codec_profile:
+ * @content: a #TfContent
+ * @filename: the key file containing the profiles
+ * @profile: the name of the profile to use, like "low-latency"
+ * @error: a #GError or %NULL
+ *
+ * Applies a profile from a key file to the #FsSession and the elements of
+ * this content. To avoid renegotiating the codecs, this should be called
+ * from the #TfChannel::content-added callback.
+ *
+ * The group named @profile can have "audio-codecs" and "video-codecs" keys
+ * listing the preferred codecs in order, and "audio-disabled-codecs" and
+ * "video-disabled-codecs" keys listing the codecs to never use. Each codec
+ * is written as ENCODING or ENCODING/clock-rate. Groups named
+ * @profile/element-name set the properties of the elements created by that
+ * factory in the codec bins of this content's session, like
+ * "[low-latency/opusenc]" with "frame-size=10". Elements shared by all the
+ * sessions of the conference are left alone.
+ *
+ * |[
+ * [low-latency]
+ * audio-codecs=OPUS/48000;G722/8000
+ * video-disabled-codecs=THEORA
+ *
+ * [low-latency/x264enc]
+ * tune=0x4
+ * ]|
+ *
+ * Returns: %TRUE if the profile was applied, %FALSE otherwise
+ *
+ * Since: 0.6.3
+ */
+
+gboolean
+tf_content_set_codec_profile (TfContent *content,
+    const gchar *filename,
+    const gchar *profile,
+    GError **error)
+{
+  GKeyFile *keyfile;
+  GKeyFile *element_properties = NULL;
+  FsConference *conference = NULL;
+  FsSession *session = NULL;
+  FsMediaType media_type;
+  GQueue prefs = G_QUEUE_INIT;
+  GList *defaults, *item;
+  gchar **groups;
+  gchar *key;
+  gboolean ret = FALSE;
+  guint i;
+
+  g_return_val_if_fail (TF_IS_CONTENT (content), FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+  g_return_val_if_fail (profile != NULL, FALSE);
+
+  keyfile = g_key_file_new ();
+
+  if (!g_key_file_load_from_file (keyfile, filename, G_KEY_FILE_NONE, error))
+    goto out;
+
+  if (!g_key_file_has_group (keyfile, profile))
+    {
+      g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_GROUP_NOT_FOUND,
+          "No profile named %s in %s", profile, filename);
+      goto out;
+    }
+
+  g_object_get (content,
+      "fs-conference", &conference,
+      "fs-session", &session,
+      "media-type", &media_type,
+      NULL);
+
+  if (session == NULL || conference == NULL)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_INITIALIZED,
+          "The content has no session yet");
+      goto out;
+    }
+
+  key = g_strdup_printf ("%s-codecs", fs_media_type_to_string (media_type));
+  add_profile_codecs (&prefs, keyfile, profile, key, media_type,
+      FS_CODEC_ID_ANY);
+  g_free (key);
+
+  key = g_strdup_printf ("%s-disabled-codecs",
+      fs_media_type_to_string (media_type));
+  add_profile_codecs (&prefs, keyfile, profile, key, media_type,
+      FS_CODEC_ID_DISABLE);
+  g_free (key);
+
+  /* Keep the default preferences for the codecs the profile doesn't
+   * mention, after the ones it does */
+  defaults = fs_utils_get_default_codec_preferences (GST_ELEMENT (conference));
+  for (item = defaults; item; item = item->next)
+    if (!codec_in_prefs (&prefs, item->data))
+      g_queue_push_tail (&prefs, fs_codec_copy (item->data));
+  fs_codec_list_destroy (defaults);
+
+  if (prefs.head &&
+      !fs_session_set_codec_preferences (session, prefs.head, error))
+    goto out;
+
+  groups = g_key_file_get_groups (keyfile, NULL);
+  for (i = 0; groups[i]; i++)
+    {
+      gchar **keys;
+      guint j;
+
+      if (!g_str_has_prefix (groups[i], profile) ||
+          groups[i][strlen (profile)] != '/')
+        continue;
+
+      if (element_properties == NULL)
+        element_properties = g_key_file_new ();
+
+      keys = g_key_file_get_keys (keyfile, groups[i], NULL, NULL);
+      for (j = 0; keys && keys[j]; j++)
+        {
+          gchar *value = g_key_file_get_value (keyfile, groups[i], keys[j],
+              NULL);
+
+          g_key_file_set_value (element_properties,
+              groups[i] + strlen (profile) + 1, keys[j], value);
+          g_free (value);
+        }
+      g_strfreev (keys);
+    }
+  g_strfreev (groups);
+
+  tf_content_clear_profile_notifier (content);
+
+  if (element_properties)
+    {
+      struct ProfileProperties *pp = g_slice_new (struct ProfileProperties);
+      guint session_id;
+
+      g_object_get (session, "id", &session_id, NULL);
+
+      /* Owned by the signal handler, so that it stays valid for emissions
+       * in progress in streaming threads when the notifier is removed */
+      pp->keyfile = element_properties;
+      pp->send_prefix = g_strdup_printf ("send_%u_", session_id);
+      pp->recv_prefix = g_strdup_printf ("recv_%u_", session_id);
+
+      content->profile_notifier = fs_element_added_notifier_new ();
+      g_signal_connect_data (content->profile_notifier, "element-added",
+          G_CALLBACK (profile_element_added), pp, profile_properties_free, 0);
+      content->profile_conference = GST_BIN (gst_object_ref (conference));
+      fs_element_added_notifier_add (content->profile_notifier,
+          content->profile_conference);
+    }
+
+  ret = TRUE;
+
+ out:
+  fs_codec_list_destroy (prefs.head);
+  if (session)
+    g_object_unref (session);
+  if (conference)
+    gst_object_unref (conference);
+  g_key_file_free (keyfile);
+
+  return ret;
+}
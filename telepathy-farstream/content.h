@@ -67,6 +67,9 @@ void tf_content_receiving_failed (TfContent *content,
 GstIterator *tf_content_iterate_src_pads (TfContent *content,
     guint *handles, guint handle_count);
 
+gboolean tf_content_set_codec_profile (TfContent *content,
+    const gchar *filename, const gchar *profile, GError **error);
+
 G_END_DECLS
 
 #endif /* __TF_CONTENT_H__ */
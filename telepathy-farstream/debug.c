@@ -0,0 +1,79 @@
+/*
+ * debug.c - Debug categories
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * The categories are selected with the TF_DEBUG environment variable, which
+ * takes a list like "codecs,candidates" or "all". When it is not set, all
+ * of them are enabled if G_MESSAGES_DEBUG would let our messages through,
+ * and none otherwise.
+ */
+
+#include "config.h"
+
+#include "debug.h"
+
+#include <string.h>
+
+/* Marks the flags as parsed, as g_once_init_leave() refuses 0 */
+#define TF_DEBUG_PARSED (1u << 31)
+
+static const GDebugKey debug_keys[] = {
+  { "content", TF_DEBUG_CONTENT },
+  { "stream", TF_DEBUG_STREAM },
+  { "candidates", TF_DEBUG_CANDIDATES },
+  { "codecs", TF_DEBUG_CODECS },
+  { "dbus", TF_DEBUG_DBUS }
+};
+
+static guint
+parse_debug_flags (void)
+{
+  const gchar *env;
+  gchar **domains;
+  guint flags = 0;
+  guint i;
+
+  env = g_getenv ("TF_DEBUG");
+  if (env != NULL)
+    return g_parse_debug_string (env, debug_keys, G_N_ELEMENTS (debug_keys));
+
+  env = g_getenv ("G_MESSAGES_DEBUG");
+  if (env == NULL)
+    return 0;
+
+  domains = g_strsplit_set (env, " ,", -1);
+  for (i = 0; domains[i]; i++)
+    if (!strcmp (domains[i], "all") || !strcmp (domains[i], G_LOG_DOMAIN))
+      flags = TF_DEBUG_CONTENT | TF_DEBUG_STREAM | TF_DEBUG_CANDIDATES |
+          TF_DEBUG_CODECS | TF_DEBUG_DBUS;
+  g_strfreev (domains);
+
+  return flags;
+}
+
+gboolean
+_tf_debug_flag_is_set (TfDebugFlags flag)
+{
+  static gsize flags = 0;
+
+  if (g_once_init_enter (&flags))
+    g_once_init_leave (&flags, parse_debug_flags () | TF_DEBUG_PARSED);
+
+  return (flags & flag) != 0;
+}
@@ -0,0 +1,48 @@
+/*
+ * debug.h - Debug categories
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TF_DEBUG_H__
+#define __TF_DEBUG_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+  TF_DEBUG_CONTENT    = 1 << 0,
+  TF_DEBUG_STREAM     = 1 << 1,
+  TF_DEBUG_CANDIDATES = 1 << 2,
+  TF_DEBUG_CODECS     = 1 << 3,
+  TF_DEBUG_DBUS       = 1 << 4
+} TfDebugFlags;
+
+gboolean _tf_debug_flag_is_set (TfDebugFlags flag);
+
+/* Use this to skip formatting debug output nobody will see */
+#define TF_DEBUG_ON(flag) _tf_debug_flag_is_set (TF_DEBUG_ ## flag)
+
+#define TF_DEBUG(flag, format, ...) \
+  G_STMT_START {                                                        \
+    if (TF_DEBUG_ON (flag))                                             \
+      g_debug (format, ##__VA_ARGS__);                                  \
+  } G_STMT_END
+
+G_END_DECLS
+
+#endif /* __TF_DEBUG_H__ */
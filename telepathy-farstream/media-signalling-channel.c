@@ -297,12 +297,14 @@ cb_properties_listed (TpProxy *proxy,
 
 
 TfMediaSignallingChannel *
-tf_media_signalling_channel_new (TpChannel *channel)
+tf_media_signalling_channel_new (TpChannel *channel,
+    GMainContext *context)
 {
   TfMediaSignallingChannel *self = g_object_new (
       TF_TYPE_MEDIA_SIGNALLING_CHANNEL, NULL);
 
   self->channel_proxy = channel;
+  self->context = g_main_context_ref (context);
 
   if (!tp_proxy_has_interface_by_id (TP_PROXY (channel),
         TP_IFACE_QUARK_PROPERTIES_INTERFACE))
@@ -383,6 +385,10 @@ tf_media_signalling_channel_dispose (GObject *object)
   g_free (self->nat_props.relay_token);
   self->nat_props.relay_token = NULL;
 
+  if (self->context)
+    g_main_context_unref (self->context);
+  self->context = NULL;
+
   if (G_OBJECT_CLASS (tf_media_signalling_channel_parent_class)->dispose)
     G_OBJECT_CLASS (tf_media_signalling_channel_parent_class)->dispose (object);
 }
@@ -635,25 +641,28 @@ tf_media_signalling_channel_bus_message (TfMediaSignallingChannel *channel,
     GstMessage *message)
 {
   guint i;
-  gboolean ret = FALSE;
 
   if (channel->session == NULL)
     return FALSE;
 
   if (_tf_session_bus_message (channel->session, message))
-    ret = TRUE;
+    return TRUE;
+
+  /* Only element messages are handled by the streams, and each of those
+   * belongs to a single stream, so stop at the first one that takes it */
+  if (GST_MESSAGE_TYPE (message) != GST_MESSAGE_ELEMENT)
+    return FALSE;
 
   for (i = 0; i < channel->streams->len; i++)
     {
       TfStream *stream = g_ptr_array_index (
           channel->streams, i);
 
-      if (stream != NULL)
-        if (_tf_stream_bus_message (stream, message))
-          ret = TRUE;
+      if (stream != NULL && _tf_stream_bus_message (stream, message))
+        return TRUE;
     }
 
-  return ret;
+  return FALSE;
 }
 
 /**
@@ -73,6 +73,8 @@ struct _TfMediaSignallingChannel {
 
   TpChannel *channel_proxy;
 
+  GMainContext *context;
+
   TfNatProperties nat_props;
   guint prop_id_nat_traversal;
   guint prop_id_stun_server;
@@ -95,7 +97,8 @@ typedef struct _TfMediaSignallingChannelClass TfMediaSignallingChannelClass;
 GType tf_media_signalling_channel_get_type (void);
 
 TfMediaSignallingChannel *tf_media_signalling_channel_new (
-    TpChannel *channel_proxy);
+    TpChannel *channel_proxy,
+    GMainContext *context);
 
 TfStream *tf_media_signalling_channel_lookup_stream (
     TfMediaSignallingChannel *chan,
@@ -0,0 +1,270 @@
+/*
+ * relay-cache.c - Resolved addresses of the TURN servers
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * The nice transmitter makes the TURN allocations itself and only accepts
+ * server addresses as IP literals. What can be done ahead of the stream is
+ * resolving the servers the CM gives by name: this is started as soon as a
+ * stream knows its relays, and the addresses are kept for the whole
+ * process and refreshed in the background when they get old, so streams
+ * only wait for the DNS the first time a server is used.
+ */
+
+#include "config.h"
+
+#include "relay-cache.h"
+
+#include <gio/gio.h>
+#include <telepathy-glib/telepathy-glib.h>
+#include <farstream/fs-conference.h>
+
+#include "debug.h"
+#include "utils.h"
+
+/* How long a resolved address is used before being resolved again */
+#define REFRESH_INTERVAL (300 * G_USEC_PER_SEC)
+
+struct RelayHost {
+  gchar *address; /* NULL until resolved */
+  gint64 resolved;
+  gboolean resolving;
+};
+
+struct RelayWaiter {
+  GSource *source;
+  GMainContext *context;
+};
+
+G_LOCK_DEFINE_STATIC (hosts);
+/* host name -> RelayHost, never freed */
+static GHashTable *hosts = NULL;
+/* RelayWaiters, woken up when any resolution finishes */
+static GSList *waiters = NULL;
+
+/* The nice transmitter gathers IPv4 candidates, so take an IPv4 address
+ * when the name has one */
+static GInetAddress *
+pick_address (GList *addresses)
+{
+  GList *item;
+
+  for (item = addresses; item; item = item->next)
+    if (g_inet_address_get_family (item->data) == G_SOCKET_FAMILY_IPV4)
+      return item->data;
+
+  return addresses->data;
+}
+
+/* Called with the lock held */
+static void
+wake_waiters (void)
+{
+  GSList *item;
+
+  for (item = waiters; item; item = item->next)
+    {
+      struct RelayWaiter *waiter = item->data;
+
+      g_source_attach (waiter->source, waiter->context);
+      g_source_unref (waiter->source);
+      if (waiter->context)
+        g_main_context_unref (waiter->context);
+      g_slice_free (struct RelayWaiter, waiter);
+    }
+
+  g_slist_free (waiters);
+  waiters = NULL;
+}
+
+static void
+host_resolved (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+  gchar *name = user_data;
+  struct RelayHost *host;
+  GList *addresses;
+  GError *error = NULL;
+
+  addresses = g_resolver_lookup_by_name_finish (G_RESOLVER (source), result,
+      &error);
+
+  G_LOCK (hosts);
+  host = g_hash_table_lookup (hosts, name);
+  host->resolving = FALSE;
+  if (addresses)
+    {
+      g_free (host->address);
+      host->address = g_inet_address_to_string (pick_address (addresses));
+      host->resolved = g_get_monotonic_time ();
+    }
+  wake_waiters ();
+  G_UNLOCK (hosts);
+
+  if (addresses)
+    TF_DEBUG (CANDIDATES, "Relay %s resolved", name);
+  else
+    TF_DEBUG (CANDIDATES, "Could not resolve relay %s: %s", name,
+        error->message);
+
+  g_clear_error (&error);
+  g_resolver_free_addresses (addresses);
+  g_free (name);
+}
+
+/* Resolves the relay servers given by name that are not resolved yet or
+ * that were resolved too long ago, the results arrive in @context */
+void
+_tf_relay_cache_prepare (GPtrArray *relay_info, GMainContext *context)
+{
+  gint64 now = g_get_monotonic_time ();
+  GResolver *resolver = NULL;
+  gboolean pushed;
+  guint i;
+
+  if (relay_info == NULL)
+    return;
+
+  pushed = push_thread_default_context (context);
+
+  for (i = 0; i < relay_info->len; i++)
+    {
+      const gchar *name = tp_asv_get_string (
+          g_ptr_array_index (relay_info, i), "ip");
+      struct RelayHost *host;
+      gboolean resolve = FALSE;
+
+      if (name == NULL || g_hostname_is_ip_address (name))
+        continue;
+
+      G_LOCK (hosts);
+      if (hosts == NULL)
+        hosts = g_hash_table_new (g_str_hash, g_str_equal);
+      host = g_hash_table_lookup (hosts, name);
+      if (host == NULL)
+        {
+          host = g_slice_new0 (struct RelayHost);
+          g_hash_table_insert (hosts, g_strdup (name), host);
+        }
+      if (!host->resolving &&
+          (host->address == NULL || now - host->resolved > REFRESH_INTERVAL))
+        {
+          host->resolving = TRUE;
+          resolve = TRUE;
+        }
+      G_UNLOCK (hosts);
+
+      if (!resolve)
+        continue;
+
+      if (resolver == NULL)
+        resolver = g_resolver_get_default ();
+      g_resolver_lookup_by_name_async (resolver, name, NULL, host_resolved,
+          g_strdup (name));
+    }
+
+  if (resolver)
+    g_object_unref (resolver);
+
+  pop_thread_default_context (context, pushed);
+}
+
+/* Returns the last known address of @host, even if it is being refreshed,
+ * or NULL if it has never been resolved */
+gchar *
+_tf_relay_cache_lookup (const gchar *host)
+{
+  struct RelayHost *h = NULL;
+  gchar *address = NULL;
+
+  G_LOCK (hosts);
+  if (hosts)
+    h = g_hash_table_lookup (hosts, host);
+  if (h)
+    address = g_strdup (h->address);
+  G_UNLOCK (hosts);
+
+  return address;
+}
+
+/* If some relays of @relay_info are being resolved for the first time,
+ * attaches @source to @context when a resolution finishes and returns
+ * %TRUE, unless _tf_relay_cache_cancel_wait() is called first */
+gboolean
+_tf_relay_cache_wait (GPtrArray *relay_info, GSource *source,
+    GMainContext *context)
+{
+  gboolean pending = FALSE;
+  guint i;
+
+  if (relay_info == NULL)
+    return FALSE;
+
+  G_LOCK (hosts);
+
+  for (i = 0; hosts && i < relay_info->len && !pending; i++)
+    {
+      const gchar *name = tp_asv_get_string (
+          g_ptr_array_index (relay_info, i), "ip");
+      struct RelayHost *host;
+
+      if (name == NULL)
+        continue;
+
+      host = g_hash_table_lookup (hosts, name);
+      pending = (host != NULL && host->resolving && host->address == NULL);
+    }
+
+  if (pending)
+    {
+      struct RelayWaiter *waiter = g_slice_new (struct RelayWaiter);
+
+      waiter->source = g_source_ref (source);
+      waiter->context = context ? g_main_context_ref (context) : NULL;
+      waiters = g_slist_prepend (waiters, waiter);
+    }
+
+  G_UNLOCK (hosts);
+
+  return pending;
+}
+
+void
+_tf_relay_cache_cancel_wait (GSource *source)
+{
+  GSList *item;
+
+  G_LOCK (hosts);
+
+  for (item = waiters; item; item = item->next)
+    {
+      struct RelayWaiter *waiter = item->data;
+
+      if (waiter->source != source)
+        continue;
+
+      waiters = g_slist_delete_link (waiters, item);
+      g_source_unref (waiter->source);
+      if (waiter->context)
+        g_main_context_unref (waiter->context);
+      g_slice_free (struct RelayWaiter, waiter);
+      break;
+    }
+
+  G_UNLOCK (hosts);
+}
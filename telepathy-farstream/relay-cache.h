@@ -0,0 +1,38 @@
+/*
+ * relay-cache.h - Resolved addresses of the TURN servers
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef __TF_RELAY_CACHE_H__
+#define __TF_RELAY_CACHE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void _tf_relay_cache_prepare (GPtrArray *relay_info, GMainContext *context);
+
+gchar *_tf_relay_cache_lookup (const gchar *host);
+
+gboolean _tf_relay_cache_wait (GPtrArray *relay_info, GSource *source,
+    GMainContext *context);
+void _tf_relay_cache_cancel_wait (GSource *source);
+
+G_END_DECLS
+
+#endif /* __TF_RELAY_CACHE_H__ */
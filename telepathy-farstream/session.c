@@ -24,6 +24,8 @@
 
 #include <farstream/fs-conference.h>
 
+#include "conference-pool.h"
+
 
 G_DEFINE_TYPE (TfSession, _tf_session, G_TYPE_OBJECT);
 
@@ -55,6 +57,8 @@ enum
 
 static guint signals[SIGNAL_COUNT] = { 0 };
 
+static GQuark farstream_error_quark = 0;
+
 static void
 _tf_session_init (TfSession *self)
 {
@@ -132,16 +136,13 @@ _tf_session_constructor (GType type,
 {
   GObject *obj;
   TfSession *self;
-  gchar *conftype;
-  GstElement *conf;
+  FsConference *conf;
 
   obj = G_OBJECT_CLASS (_tf_session_parent_class)->
            constructor (type, n_props, props);
   self = (TfSession *) obj;
 
-  conftype = g_strdup_printf ("fs%sconference", self->priv->session_type);
-  conf = gst_element_factory_make (conftype, NULL);
-  g_free (conftype);
+  conf = _tf_conference_pool_get (self->priv->session_type);
 
   if (!conf)
     {
@@ -150,7 +151,7 @@ _tf_session_constructor (GType type,
       return obj;
     }
 
-  self->priv->fs_conference = FS_CONFERENCE (gst_object_ref (conf));
+  self->priv->fs_conference = conf;
 
   self->priv->fs_participant =
       fs_conference_new_participant (self->priv->fs_conference,
@@ -221,6 +222,8 @@ _tf_session_class_init (TfSessionClass *klass)
 
   g_type_class_add_private (klass, sizeof (TfSessionPrivate));
 
+  farstream_error_quark = g_quark_from_static_string ("farstream-error");
+
   object_class->set_property = _tf_session_set_property;
   object_class->get_property = _tf_session_get_property;
 
@@ -414,7 +417,8 @@ _tf_session_bus_message (TfSession *session,
       {
         const GstStructure *s = gst_message_get_structure (message);
 
-        if (gst_structure_has_name (s, "farstream-error"))
+        if (s != NULL &&
+            gst_structure_get_name_id (s) == farstream_error_quark)
           {
             GObject *object;
             const GValue *value = NULL;
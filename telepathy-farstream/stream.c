@@ -43,18 +43,22 @@
 
 #include "stream.h"
 #include "media-signalling-channel.h"
+#include "debug.h"
 #include "utils.h"
 
 G_DEFINE_TYPE (TfStream, tf_stream, G_TYPE_OBJECT);
 
-#define DEBUG(stream, format, ...) \
-  g_debug ("stream %d %p (%s) %s: " format, \
+#define STREAM_DEBUG(flag, stream, format, ...) \
+  TF_DEBUG (flag, "stream %d %p (%s) %s: " format, \
     stream->stream_id, stream,                                   \
     (stream->priv->media_type == TP_MEDIA_STREAM_TYPE_AUDIO) ? "audio"  \
                                                       : "video", \
     G_STRFUNC, \
     ##__VA_ARGS__)
 
+#define DEBUG(stream, format, ...) \
+  STREAM_DEBUG (STREAM, stream, format, ##__VA_ARGS__)
+
 #define WARNING(stream, format, ...) \
   g_warning ("stream %d %p (%s) %s: " format, \
     stream->stream_id, stream,                                   \
@@ -105,8 +109,10 @@ struct _TfStreamPrivate
   GHashTable *feedback_messages;
   GPtrArray *header_extensions;
 
+  GMainContext *context;
+
   GStaticMutex mutex;
-  guint idle_connected_id; /* Protected by mutex */
+  GSource *idle_connected_source; /* Protected by mutex */
   gboolean disposed; /* Protected by mutex */
 
   TpMediaStreamState current_state;
@@ -235,6 +241,8 @@ static void cb_fs_component_state_changed (TfStream *self,
     guint component,
     FsStreamState fsstate);
 
+static void init_message_handlers (void);
+
 
 static void
 tf_stream_init (TfStream *self)
@@ -400,9 +408,12 @@ tf_stream_dispose (GObject *object)
   gpointer data;
 
   TF_STREAM_LOCK (stream);
-  if (stream->priv->idle_connected_id)
-    g_source_remove (stream->priv->idle_connected_id);
-  stream->priv->idle_connected_id = 0;
+  if (stream->priv->idle_connected_source)
+    {
+      g_source_destroy (stream->priv->idle_connected_source);
+      g_source_unref (stream->priv->idle_connected_source);
+    }
+  stream->priv->idle_connected_source = NULL;
 
   stream->priv->disposed = TRUE;
   TF_STREAM_UNLOCK (stream);
@@ -480,6 +491,10 @@ tf_stream_dispose (GObject *object)
   fs_candidate_list_destroy (priv->local_candidates);
   priv->local_candidates = NULL;
 
+  if (priv->context)
+    g_main_context_unref (priv->context);
+  priv->context = NULL;
+
   if (G_OBJECT_CLASS (tf_stream_parent_class)->dispose)
     G_OBJECT_CLASS (tf_stream_parent_class)->dispose (object);
 }
@@ -491,6 +506,8 @@ tf_stream_class_init (TfStreamClass *klass)
 
   g_type_class_add_private (klass, sizeof (TfStreamPrivate));
 
+  init_message_handlers ();
+
   object_class->set_property = tf_stream_set_property;
   object_class->get_property = tf_stream_get_property;
   object_class->constructor = tf_stream_constructor;
@@ -1421,10 +1438,8 @@ fs_codecs_to_tp (TfStream *stream,
   for (el = codecs; el; el = g_list_next (el))
     {
       FsCodec *fsc = el->data;
-      GValue codec = { 0, };
+      GValueArray *codec;
       TpMediaStreamType type;
-      GHashTable *params;
-      GList *cur;
 
       switch (fsc->media_type) {
         case FS_MEDIA_TYPE_AUDIO:
@@ -1439,35 +1454,22 @@ fs_codecs_to_tp (TfStream *stream,
           return NULL;
       }
 
-      /* fill in optional parameters */
-      params = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
-
-      for (cur = fsc->optional_params; cur != NULL; cur = cur->next)
-        {
-          FsCodecParameter *param = (FsCodecParameter *) cur->data;
-
-          g_hash_table_insert (params, g_strdup (param->name),
-                               g_strdup (param->value));
-        }
-
-      g_value_init (&codec, TP_STRUCT_TYPE_MEDIA_STREAM_HANDLER_CODEC);
-      g_value_take_boxed (&codec,
-          dbus_g_type_specialized_construct (TP_STRUCT_TYPE_MEDIA_STREAM_HANDLER_CODEC));
-
-      dbus_g_type_struct_set (&codec,
-          0, fsc->id,
-          1, fsc->encoding_name,
-          2, type,
-          3, fsc->clock_rate,
-          4, fsc->channels,
-          5, params,
-          G_MAXUINT);
-
-      g_hash_table_destroy (params);
+      /* fill in optional parameters, they are handed over to the struct
+       * instead of being copied into it */
+      codec = tp_value_array_build (6,
+          G_TYPE_UINT, fsc->id,
+          G_TYPE_STRING, fsc->encoding_name,
+          G_TYPE_UINT, type,
+          G_TYPE_UINT, fsc->clock_rate,
+          G_TYPE_UINT, fsc->channels,
+          DBUS_TYPE_G_STRING_STRING_HASHTABLE, NULL,
+          G_TYPE_INVALID);
+      g_value_take_boxed (g_value_array_get_nth (codec, 5),
+          fscodec_params_to_tp (fsc));
 
       DEBUG (stream, "adding codec " FS_CODEC_FORMAT, FS_CODEC_ARGS (fsc));
 
-      g_ptr_array_add (tp_codecs, g_value_get_boxed (&codec));
+      g_ptr_array_add (tp_codecs, codec);
     }
 
   return tp_codecs;
@@ -1598,8 +1600,6 @@ set_remote_codecs (TpMediaStreamHandler *proxy G_GNUC_UNUSED,
     GObject *object)
 {
   TfStream *self = TF_STREAM (object);
-  GValueArray *codec;
-  GHashTable *params = NULL;
   GList *fs_remote_codecs = NULL;
   guint i;
   GError *error = NULL;
@@ -1609,29 +1609,18 @@ set_remote_codecs (TpMediaStreamHandler *proxy G_GNUC_UNUSED,
   for (i = 0; i < codecs->len; i++)
     {
       FsCodec *fs_codec = NULL;
+      guint id, media_type, clock_rate, channels;
+      const gchar *encoding_name;
+      GHashTable *params;
 
+      /* dbus-glib already checked the signature, so the members can be
+       * read in place */
+      tp_value_array_unpack (g_ptr_array_index (codecs, i), 6,
+          &id, &encoding_name, &media_type, &clock_rate, &channels, &params);
 
-      codec = g_ptr_array_index (codecs, i);
-
-      g_assert(G_VALUE_HOLDS_UINT (g_value_array_get_nth (codec,0)));
-      g_assert(G_VALUE_HOLDS_STRING (g_value_array_get_nth (codec,1)));
-      g_assert(G_VALUE_HOLDS_UINT (g_value_array_get_nth (codec,2)));
-      g_assert(G_VALUE_HOLDS_UINT (g_value_array_get_nth (codec,3)));
-      g_assert(G_VALUE_HOLDS_UINT (g_value_array_get_nth (codec,4)));
-      g_assert(G_VALUE_TYPE (g_value_array_get_nth (codec, 5)) ==
-                               DBUS_TYPE_G_STRING_STRING_HASHTABLE);
-
-
-      fs_codec = fs_codec_new (
-          g_value_get_uint (g_value_array_get_nth (codec, 0)), /* id */
-          g_value_get_string (g_value_array_get_nth (codec, 1)), /* encoding_name */
-          g_value_get_uint (g_value_array_get_nth (codec, 2)), /* media_type */
-          g_value_get_uint (g_value_array_get_nth (codec, 3))); /* clock_rate */
-
-      fs_codec->channels =
-          g_value_get_uint (g_value_array_get_nth (codec, 4));
+      fs_codec = fs_codec_new (id, encoding_name, media_type, clock_rate);
+      fs_codec->channels = channels;
 
-      params = g_value_get_boxed (g_value_array_get_nth (codec, 5));
       g_hash_table_foreach (params, fill_fs_params, fs_codec);
 
       if (self->priv->feedback_messages)
@@ -2235,12 +2224,12 @@ cb_fs_recv_codecs_changed (TfStream *self,
   GList *item;
 
   for (item = codecs;
-       item;
+       item && TF_DEBUG_ON (CODECS);
        item = g_list_next (item))
     {
       gchar *str = fs_codec_to_string (item->data);
 
-      DEBUG (self, "receiving codec: %s", str);
+      STREAM_DEBUG (CODECS, self, "receiving codec: %s", str);
       g_free (str);
     }
 
@@ -2414,228 +2403,294 @@ tf_stream_error (TfStream *self,
 }
 
 
-/**
- * _tf_stream_bus_message:
- * @stream: A #TfStream
- * @message: A #GstMessage received from the bus
- *
- * You must call this function on call messages received on the async bus.
- * #GstMessages are not modified.
- *
- * Returns: %TRUE if the message has been handled, %FALSE otherwise
- */
+static gboolean
+stream_message_error (TfStream *stream, const GstStructure *s)
+{
+  GObject *object;
+  const GValue *value = NULL;
+  const gchar *msg;
+  FsError errorno;
+  GEnumClass *enumclass;
+  GEnumValue *enumvalue;
+
+  value = gst_structure_get_value (s, "src-object");
+  object = g_value_get_object (value);
+
+  if (object != (GObject*) stream->priv->fs_session &&
+      object != (GObject*) stream->priv->fs_stream)
+    return FALSE;
 
-gboolean
-_tf_stream_bus_message (TfStream *stream,
-    GstMessage *message)
+  value = gst_structure_get_value (s, "error-no");
+  errorno = g_value_get_enum (value);
+  msg = gst_structure_get_string (s, "error-msg");
+
+  enumclass = g_type_class_ref (FS_TYPE_ERROR);
+  enumvalue = g_enum_get_value (enumclass, errorno);
+  WARNING (stream, "error (%s (%d)): %s",
+      enumvalue->value_nick, errorno, msg);
+  g_type_class_unref (enumclass);
+
+  tf_stream_error (stream, fserrorno_to_tperrorno (errorno), msg);
+  return TRUE;
+}
+
+static gboolean
+stream_message_new_local_candidate (TfStream *stream, const GstStructure *s)
 {
-  const GstStructure *s = gst_message_get_structure (message);
+  FsStream *fsstream;
+  FsCandidate *candidate;
+  const GValue *value;
 
-  if (GST_MESSAGE_TYPE (message) != GST_MESSAGE_ELEMENT)
+  value = gst_structure_get_value (s, "stream");
+  fsstream = g_value_get_object (value);
+
+  g_debug ("new local fs: %p s:%p", stream->priv->fs_stream, stream);
+
+  if (fsstream != stream->priv->fs_stream)
     return FALSE;
 
-  if (!stream->priv->fs_stream || !stream->priv->fs_session)
+  value = gst_structure_get_value (s, "candidate");
+  candidate = g_value_get_boxed (value);
+
+  g_debug ("NEW LOCAL CAND");
+
+  cb_fs_new_local_candidate (stream, candidate);
+  return TRUE;
+}
+
+static gboolean
+stream_message_local_candidates_prepared (TfStream *stream,
+    const GstStructure *s)
+{
+  FsStream *fsstream;
+  const GValue *value;
+
+  value = gst_structure_get_value (s, "stream");
+  fsstream = g_value_get_object (value);
+
+  g_debug ("local cand prep fs: %p s:%p", stream->priv->fs_stream, stream);
+
+  if (fsstream != stream->priv->fs_stream)
     return FALSE;
 
-  if (gst_structure_has_name (s, "farstream-error"))
-    {
-      GObject *object;
-      const GValue *value = NULL;
+  g_debug ("LOCAL CAND PREP");
 
-      value = gst_structure_get_value (s, "src-object");
-      object = g_value_get_object (value);
+  cb_fs_local_candidates_prepared (stream);
 
-      if (object == (GObject*) stream->priv->fs_session ||
-          object == (GObject*) stream->priv->fs_stream)
-        {
-          const gchar *msg;
-          FsError errorno;
-          GEnumClass *enumclass;
-          GEnumValue *enumvalue;
-
-          value = gst_structure_get_value (s, "error-no");
-          errorno = g_value_get_enum (value);
-          msg = gst_structure_get_string (s, "error-msg");
-
-          enumclass = g_type_class_ref (FS_TYPE_ERROR);
-          enumvalue = g_enum_get_value (enumclass, errorno);
-          WARNING (stream, "error (%s (%d)): %s",
-              enumvalue->value_nick, errorno, msg);
-          g_type_class_unref (enumclass);
-
-          tf_stream_error (stream, fserrorno_to_tperrorno (errorno), msg);
-          return TRUE;
-        }
-    }
-  else if (gst_structure_has_name (s, "farstream-new-local-candidate"))
-    {
-      FsStream *fsstream;
-      FsCandidate *candidate;
-      const GValue *value;
+  return TRUE;
+}
 
-      value = gst_structure_get_value (s, "stream");
-      fsstream = g_value_get_object (value);
+static gboolean
+stream_message_new_active_candidate_pair (TfStream *stream,
+    const GstStructure *s)
+{
+  FsStream *fsstream;
+  FsCandidate *local_candidate;
+  FsCandidate *remote_candidate;
+  const GValue *value;
 
-      g_debug ("new local fs: %p s:%p", stream->priv->fs_stream, stream);
+  value = gst_structure_get_value (s, "stream");
+  fsstream = g_value_get_object (value);
 
-      if (fsstream != stream->priv->fs_stream)
-        return FALSE;
+  if (fsstream != stream->priv->fs_stream)
+    return FALSE;
 
-      value = gst_structure_get_value (s, "candidate");
-      candidate = g_value_get_boxed (value);
+  value = gst_structure_get_value (s, "local-candidate");
+  local_candidate = g_value_get_boxed (value);
 
-      g_debug ("NEW LOCAL CAND");
+  value = gst_structure_get_value (s, "remote-candidate");
+  remote_candidate = g_value_get_boxed (value);
 
-      cb_fs_new_local_candidate (stream, candidate);
-      return TRUE;
-    }
-  else if (gst_structure_has_name (s, "farstream-local-candidates-prepared"))
-    {
-      FsStream *fsstream;
-      const GValue *value;
+  cb_fs_new_active_candidate_pair (stream, local_candidate, remote_candidate);
+  return TRUE;
+}
+
+static gboolean
+stream_message_current_recv_codecs_changed (TfStream *stream,
+    const GstStructure *s)
+{
+  FsStream *fsstream;
+  GList *codecs;
+  const GValue *value;
 
-      value = gst_structure_get_value (s, "stream");
-      fsstream = g_value_get_object (value);
+  value = gst_structure_get_value (s, "stream");
+  fsstream = g_value_get_object (value);
 
-      g_debug ("local cand prep fs: %p s:%p", stream->priv->fs_stream, stream);
+  if (fsstream != stream->priv->fs_stream)
+    return FALSE;
 
-      if (fsstream != stream->priv->fs_stream)
-        return FALSE;
+  value = gst_structure_get_value (s, "codecs");
+  codecs = g_value_get_boxed (value);
 
-      g_debug ("LOCAL CAND PREP");
+  cb_fs_recv_codecs_changed (stream, codecs);
+  return TRUE;
+}
 
-      cb_fs_local_candidates_prepared (stream);
+static gboolean
+stream_message_codecs_changed (TfStream *stream, const GstStructure *s)
+{
+  FsSession *fssession;
+  const GValue *value;
 
-      return TRUE;
-    }
-  else if (gst_structure_has_name (s, "farstream-new-active-candidate-pair"))
-    {
-      FsStream *fsstream;
-      FsCandidate *local_candidate;
-      FsCandidate *remote_candidate;
-      const GValue *value;
+  value = gst_structure_get_value (s, "session");
+  fssession = g_value_get_object (value);
 
-      value = gst_structure_get_value (s, "stream");
-      fsstream = g_value_get_object (value);
+  if (fssession != stream->priv->fs_session)
+    return FALSE;
 
-      if (fsstream != stream->priv->fs_stream)
-        return FALSE;
+  DEBUG (stream, "Codecs changed");
 
-      value = gst_structure_get_value (s, "local-candidate");
-      local_candidate = g_value_get_boxed (value);
+  _tf_stream_try_sending_codecs (stream);
 
-      value = gst_structure_get_value (s, "remote-candidate");
-      remote_candidate = g_value_get_boxed (value);
+  return TRUE;
+}
 
-      cb_fs_new_active_candidate_pair (stream, local_candidate, remote_candidate);
-      return TRUE;
-    }
-  else if (gst_structure_has_name (s, "farstream-current-recv-codecs-changed"))
-    {
-      FsStream *fsstream;
-      GList *codecs;
-      const GValue *value;
+static gboolean
+stream_message_send_codec_changed (TfStream *stream, const GstStructure *s)
+{
+  FsSession *fssession;
+  const GValue *value;
+  FsCodec *codec = NULL;
+  GList *secondary_codecs = NULL;
+  FsCodec *objcodec = NULL;
 
-      value = gst_structure_get_value (s, "stream");
-      fsstream = g_value_get_object (value);
+  value = gst_structure_get_value (s, "session");
+  fssession = g_value_get_object (value);
 
-      if (fsstream != stream->priv->fs_stream)
-        return FALSE;
+  if (fssession != stream->priv->fs_session)
+    return FALSE;
 
-      value = gst_structure_get_value (s, "codecs");
-      codecs = g_value_get_boxed (value);
+  value = gst_structure_get_value (s, "codec");
+  codec = g_value_get_boxed (value);
+  g_object_get (fssession, "current-send-codec", &objcodec, NULL);
 
-      cb_fs_recv_codecs_changed (stream, codecs);
+  if (!fs_codec_are_equal (objcodec, codec))
+    {
+      fs_codec_destroy (objcodec);
       return TRUE;
     }
-  else if (gst_structure_has_name (s, "farstream-codecs-changed"))
-    {
-      FsSession *fssession;
-      const GValue *value;
 
-      value = gst_structure_get_value (s, "session");
-      fssession = g_value_get_object (value);
+  value = gst_structure_get_value (s, "secondary-codecs");
+  secondary_codecs = g_value_get_boxed (value);
 
-      if (fssession != stream->priv->fs_session)
-        return FALSE;
 
-      DEBUG (stream, "Codecs changed");
+  if (codec)
+    DEBUG (stream, "Send codec changed: " FS_CODEC_FORMAT,
+        FS_CODEC_ARGS (codec));
 
-      _tf_stream_try_sending_codecs (stream);
+  cb_fs_send_codec_changed (stream, codec, secondary_codecs);
+  return TRUE;
+}
 
-      return TRUE;
-    }
-  else if (gst_structure_has_name (s, "farstream-send-codec-changed"))
-    {
-      FsSession *fssession;
-      const GValue *value;
-      FsCodec *codec = NULL;
-      GList *secondary_codecs = NULL;
-      FsCodec *objcodec = NULL;
+static gboolean
+stream_message_component_state_changed (TfStream *stream,
+    const GstStructure *s)
+{
+  FsStream *fsstream;
+  const GValue *value;
+  guint component;
+  FsStreamState fsstate;
 
-      value = gst_structure_get_value (s, "session");
-      fssession = g_value_get_object (value);
+  value = gst_structure_get_value (s, "stream");
+  fsstream = g_value_get_object (value);
 
-      if (fssession != stream->priv->fs_session)
-        return FALSE;
+  if (fsstream != stream->priv->fs_stream)
+    return FALSE;
 
-      value = gst_structure_get_value (s, "codec");
-      codec = g_value_get_boxed (value);
-      g_object_get (fssession, "current-send-codec", &objcodec, NULL);
+  if (!gst_structure_get_uint (s, "component", &component) ||
+      !gst_structure_get_enum (s, "state", FS_TYPE_STREAM_STATE,
+          (gint*) &fsstate))
+    return TRUE;
 
-      if (!fs_codec_are_equal (objcodec, codec))
-        {
-          fs_codec_destroy (objcodec);
-          return TRUE;
-        }
+  cb_fs_component_state_changed (stream, component, fsstate);
+  return TRUE;
+}
 
-      value = gst_structure_get_value (s, "secondary-codecs");
-      secondary_codecs = g_value_get_boxed (value);
+static gboolean
+stream_message_renegotiate (TfStream *stream, const GstStructure *s)
+{
+  FsSession *fssession;
+  const GValue *value;
 
+  value = gst_structure_get_value (s, "session");
+  fssession = g_value_get_object (value);
 
-      if (codec)
-        DEBUG (stream, "Send codec changed: " FS_CODEC_FORMAT,
-            FS_CODEC_ARGS (codec));
+  if (fssession != stream->priv->fs_session)
+    return FALSE;
 
-      cb_fs_send_codec_changed (stream, codec, secondary_codecs);
-      return TRUE;
-    }
-  else if (gst_structure_has_name (s, "farstream-component-state-changed"))
-    {
-      FsStream *fsstream;
-      const GValue *value;
-      guint component;
-      FsStreamState fsstate;
+  g_signal_emit (stream, signals[RESTART_SOURCE], 0);
 
-      value = gst_structure_get_value (s, "stream");
-      fsstream = g_value_get_object (value);
+  return TRUE;
+}
 
-      if (fsstream != stream->priv->fs_stream)
-        return FALSE;
+/* The structure names are turned into quarks once in class_init, so
+ * dispatching a message is a GQuark compare per entry instead of a string
+ * compare per entry */
+static struct {
+  const gchar *name;
+  GQuark quark;
+  gboolean (*handle) (TfStream *stream, const GstStructure *s);
+} message_handlers[] = {
+  { "farstream-error", 0, stream_message_error },
+  { "farstream-new-local-candidate", 0, stream_message_new_local_candidate },
+  { "farstream-local-candidates-prepared", 0,
+    stream_message_local_candidates_prepared },
+  { "farstream-new-active-candidate-pair", 0,
+    stream_message_new_active_candidate_pair },
+  { "farstream-current-recv-codecs-changed", 0,
+    stream_message_current_recv_codecs_changed },
+  { "farstream-codecs-changed", 0, stream_message_codecs_changed },
+  { "farstream-send-codec-changed", 0, stream_message_send_codec_changed },
+  { "farstream-component-state-changed", 0,
+    stream_message_component_state_changed },
+  { "farstream-renegotiate", 0, stream_message_renegotiate },
+  { NULL, 0, NULL }
+};
 
-      if (!gst_structure_get_uint (s, "component", &component) ||
-          !gst_structure_get_enum (s, "state", FS_TYPE_STREAM_STATE,
-              (gint*) &fsstate))
-        return TRUE;
+static void
+init_message_handlers (void)
+{
+  guint i;
 
-      cb_fs_component_state_changed (stream, component, fsstate);
-      return TRUE;
-    }
-  else if (gst_structure_has_name (s, "farstream-renegotiate"))
-    {
-      FsSession *fssession;
-      const GValue *value;
+  for (i = 0; message_handlers[i].name; i++)
+    message_handlers[i].quark =
+        g_quark_from_static_string (message_handlers[i].name);
+}
 
-      value = gst_structure_get_value (s, "session");
-      fssession = g_value_get_object (value);
+/**
+ * _tf_stream_bus_message:
+ * @stream: A #TfStream
+ * @message: A #GstMessage received from the bus
+ *
+ * You must call this function on call messages received on the async bus.
+ * #GstMessages are not modified.
+ *
+ * Returns: %TRUE if the message has been handled, %FALSE otherwise
+ */
 
-      if (fssession != stream->priv->fs_session)
-        return FALSE;
+gboolean
+_tf_stream_bus_message (TfStream *stream,
+    GstMessage *message)
+{
+  const GstStructure *s;
+  GQuark name;
+  guint i;
 
-      g_signal_emit (stream, signals[RESTART_SOURCE], 0);
+  if (GST_MESSAGE_TYPE (message) != GST_MESSAGE_ELEMENT)
+    return FALSE;
 
-      return TRUE;
-    }
+  if (!stream->priv->fs_stream || !stream->priv->fs_session)
+    return FALSE;
+
+  s = gst_message_get_structure (message);
+  if (s == NULL)
+    return FALSE;
+
+  name = gst_structure_get_name_id (s);
+
+  for (i = 0; message_handlers[i].name; i++)
+    if (message_handlers[i].quark == name)
+      return message_handlers[i].handle (stream, s);
 
   return FALSE;
 }
@@ -2646,7 +2701,9 @@ emit_connected (gpointer data)
   TfStream *self = TF_STREAM (data);
 
   TF_STREAM_LOCK (self);
-  self->priv->idle_connected_id = 0;
+  if (self->priv->idle_connected_source)
+    g_source_unref (self->priv->idle_connected_source);
+  self->priv->idle_connected_source = NULL;
   if (self->priv->disposed)
   {
     TF_STREAM_UNLOCK (self);
@@ -2681,8 +2738,9 @@ cb_fs_stream_src_pad_added (FsStream *fsstream G_GNUC_UNUSED,
     return;
   }
 
-  if (!self->priv->idle_connected_id)
-    self->priv->idle_connected_id = g_idle_add (emit_connected, self);
+  if (!self->priv->idle_connected_source)
+    self->priv->idle_connected_source = attach_timeout_source (
+        self->priv->context, 0, emit_connected, self);
   TF_STREAM_UNLOCK (self);
 
   g_signal_emit (self, signals[SRC_PAD_ADDED], 0, pad, codec);
@@ -2715,6 +2773,8 @@ _tf_stream_new (gpointer channel,
       NULL);
 
   self->priv->new_stream_created_cb = new_stream_created_cb;
+  self->priv->context = g_main_context_ref (
+      TF_MEDIA_SIGNALLING_CHANNEL (channel)->context);
 
   return self;
 }
@@ -2845,10 +2905,12 @@ _tf_stream_try_sending_codecs (TfStream *stream)
       return;
     }
 
-  for(item = fscodecs; item; item = g_list_next (item))
+  for(item = fscodecs;
+      item && TF_DEBUG_ON (CODECS);
+      item = g_list_next (item))
     {
       gchar *tmp = fs_codec_to_string (item->data);
-      DEBUG (stream, "%s", tmp);
+      STREAM_DEBUG (CODECS, stream, "%s", tmp);
       g_free (tmp);
     }
 
@@ -0,0 +1,303 @@
+/*
+ * stun-cache.c - Health of the STUN servers
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * The nice transmitter only takes one STUN server, and gathering the server
+ * reflexive candidates waits for its timeout if that server is slow or
+ * dead. So every STUN server given by the CM is sent a Binding Request in
+ * the background, and the round-trip times and failures are remembered for
+ * the whole process. Each new stream then uses the fastest server that
+ * answered, the servers are probed again once the results get old.
+ */
+
+#include "config.h"
+
+#include "stun-cache.h"
+
+#include <string.h>
+
+#include <gio/gio.h>
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "debug.h"
+
+/* How long a result is trusted before probing the server again */
+#define PROBE_INTERVAL (60 * G_USEC_PER_SEC)
+/* How long to wait for a reply before marking the server as failed */
+#define PROBE_TIMEOUT 3000
+
+#define STUN_HEADER_SIZE 20
+#define STUN_BINDING_REQUEST 0x0001
+#define STUN_BINDING_RESPONSE 0x0101
+#define STUN_MAGIC_COOKIE 0x2112A442
+
+struct StunServerStats {
+  gint64 last_probe;
+  gint64 rtt; /* -1 until the server has answered */
+  gboolean failed; /* the last probe got no answer */
+  gboolean probing; /* stale after PROBE_TIMEOUT, if its context never ran */
+};
+
+struct StunProbe {
+  gchar *key;
+  GSocket *socket;
+  GSource *read_source;
+  GSource *timeout_source;
+  guint8 request[STUN_HEADER_SIZE];
+  gint64 start;
+};
+
+G_LOCK_DEFINE_STATIC (stats);
+/* "ip:port" -> StunServerStats, never freed */
+static GHashTable *stats = NULL;
+
+static gchar *
+server_key (GValueArray *server, gchar **ip, guint *port)
+{
+  tp_value_array_unpack (server, 2, ip, port);
+
+  return g_strdup_printf ("%s:%u", *ip, *port);
+}
+
+/* Called with the lock held */
+static struct StunServerStats *
+get_stats (const gchar *key)
+{
+  struct StunServerStats *s;
+
+  if (stats == NULL)
+    stats = g_hash_table_new (g_str_hash, g_str_equal);
+
+  s = g_hash_table_lookup (stats, key);
+  if (s == NULL)
+    {
+      s = g_slice_new0 (struct StunServerStats);
+      s->rtt = -1;
+      g_hash_table_insert (stats, g_strdup (key), s);
+    }
+
+  return s;
+}
+
+static void
+probe_finish (struct StunProbe *probe, gint64 rtt)
+{
+  struct StunServerStats *s;
+
+  G_LOCK (stats);
+  s = get_stats (probe->key);
+  s->probing = FALSE;
+  s->failed = (rtt < 0);
+  if (rtt >= 0)
+    s->rtt = rtt;
+  G_UNLOCK (stats);
+
+  if (rtt >= 0)
+    TF_DEBUG (CANDIDATES, "STUN server %s answered in %" G_GINT64_FORMAT
+        " us", probe->key, rtt);
+  else
+    TF_DEBUG (CANDIDATES, "STUN server %s did not answer", probe->key);
+
+  g_source_destroy (probe->read_source);
+  g_source_unref (probe->read_source);
+  g_source_destroy (probe->timeout_source);
+  g_source_unref (probe->timeout_source);
+  g_object_unref (probe->socket);
+  g_free (probe->key);
+  g_slice_free (struct StunProbe, probe);
+}
+
+static gboolean
+probe_readable (GSocket *socket, GIOCondition condition, gpointer user_data)
+{
+  struct StunProbe *probe = user_data;
+  guint8 buffer[512];
+  gssize len;
+
+  len = g_socket_receive (socket, (gchar *) buffer, sizeof (buffer), NULL,
+      NULL);
+
+  /* Ignore anything that isn't the answer to our request */
+  if (len < STUN_HEADER_SIZE ||
+      ((buffer[0] << 8) | buffer[1]) != STUN_BINDING_RESPONSE ||
+      memcmp (buffer + 4, probe->request + 4, STUN_HEADER_SIZE - 4))
+    return TRUE;
+
+  probe_finish (probe, g_get_monotonic_time () - probe->start);
+
+  return FALSE;
+}
+
+static gboolean
+probe_timeout (gpointer user_data)
+{
+  probe_finish (user_data, -1);
+
+  return FALSE;
+}
+
+static gboolean
+probe_server (const gchar *key, const gchar *ip, guint port,
+    GMainContext *context)
+{
+  struct StunProbe *probe;
+  GInetAddress *address;
+  GSocketAddress *sockaddr;
+  GSocket *socket;
+  guint32 cookie = g_htonl (STUN_MAGIC_COOKIE);
+  guint i;
+
+  address = g_inet_address_new_from_string (ip);
+  if (address == NULL)
+    return FALSE;
+
+  socket = g_socket_new (g_inet_address_get_family (address),
+      G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_UDP, NULL);
+  if (socket == NULL)
+    {
+      g_object_unref (address);
+      return FALSE;
+    }
+  g_socket_set_blocking (socket, FALSE);
+
+  probe = g_slice_new0 (struct StunProbe);
+  probe->key = g_strdup (key);
+  probe->socket = socket;
+
+  /* Binding Request without attributes, with a random transaction id */
+  probe->request[0] = STUN_BINDING_REQUEST >> 8;
+  probe->request[1] = STUN_BINDING_REQUEST & 0xff;
+  memcpy (probe->request + 4, &cookie, sizeof (cookie));
+  for (i = 8; i < STUN_HEADER_SIZE; i++)
+    probe->request[i] = g_random_int_range (0, 256);
+
+  sockaddr = g_inet_socket_address_new (address, port);
+  probe->start = g_get_monotonic_time ();
+  g_socket_send_to (socket, sockaddr, (gchar *) probe->request,
+      STUN_HEADER_SIZE, NULL, NULL);
+  g_object_unref (sockaddr);
+  g_object_unref (address);
+
+  probe->read_source = g_socket_create_source (socket, G_IO_IN, NULL);
+  g_source_set_callback (probe->read_source, (GSourceFunc) probe_readable,
+      probe, NULL);
+  g_source_attach (probe->read_source, context);
+
+  probe->timeout_source = g_timeout_source_new (PROBE_TIMEOUT);
+  g_source_set_callback (probe->timeout_source, probe_timeout, probe, NULL);
+  g_source_attach (probe->timeout_source, context);
+
+  return TRUE;
+}
+
+/* Probes the servers that have not been probed recently, the replies are
+ * dispatched in @context */
+void
+_tf_stun_cache_probe (GPtrArray *stun_servers, GMainContext *context)
+{
+  gint64 now = g_get_monotonic_time ();
+  guint i;
+
+  /* With a single server, there is nothing to choose from */
+  if (stun_servers == NULL || stun_servers->len < 2)
+    return;
+
+  for (i = 0; i < stun_servers->len; i++)
+    {
+      struct StunServerStats *s;
+      gboolean probe = FALSE;
+      gchar *ip;
+      guint port;
+      gchar *key;
+
+      key = server_key (g_ptr_array_index (stun_servers, i), &ip, &port);
+
+      G_LOCK (stats);
+      s = get_stats (key);
+      /* A probe whose context stopped running never finishes, forget it
+       * once it would have timed out */
+      if (s->probing && now - s->last_probe > PROBE_TIMEOUT * 1000)
+        {
+          s->probing = FALSE;
+          s->failed = TRUE;
+        }
+      if (!s->probing &&
+          (s->last_probe == 0 || now - s->last_probe > PROBE_INTERVAL))
+        {
+          s->probing = TRUE;
+          s->last_probe = now;
+          probe = TRUE;
+        }
+      G_UNLOCK (stats);
+
+      if (probe && !probe_server (key, ip, port, context))
+        {
+          G_LOCK (stats);
+          s->probing = FALSE;
+          s->failed = TRUE;
+          G_UNLOCK (stats);
+        }
+
+      g_free (key);
+    }
+}
+
+/* Returns the index of the server to use: the fastest one that answered,
+ * or else the first one that wasn't found dead */
+guint
+_tf_stun_cache_pick (GPtrArray *stun_servers)
+{
+  guint best = 0;
+  gint64 best_rtt = -1;
+  gint first_unknown = -1;
+  guint i;
+
+  G_LOCK (stats);
+
+  for (i = 0; stats && i < stun_servers->len; i++)
+    {
+      struct StunServerStats *s;
+      gchar *ip;
+      guint port;
+      gchar *key;
+
+      key = server_key (g_ptr_array_index (stun_servers, i), &ip, &port);
+      s = g_hash_table_lookup (stats, key);
+      g_free (key);
+
+      if (s == NULL || (!s->failed && s->rtt < 0))
+        {
+          if (first_unknown < 0)
+            first_unknown = i;
+        }
+      else if (!s->failed && (best_rtt < 0 || s->rtt < best_rtt))
+        {
+          best = i;
+          best_rtt = s->rtt;
+        }
+    }
+
+  G_UNLOCK (stats);
+
+  if (best_rtt < 0 && first_unknown >= 0)
+    best = first_unknown;
+
+  return best;
+}
@@ -0,0 +1,34 @@
+/*
+ * stun-cache.h - Health of the STUN servers
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef __TF_STUN_CACHE_H__
+#define __TF_STUN_CACHE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void _tf_stun_cache_probe (GPtrArray *stun_servers, GMainContext *context);
+
+guint _tf_stun_cache_pick (GPtrArray *stun_servers);
+
+G_END_DECLS
+
+#endif /* __TF_STUN_CACHE_H__ */
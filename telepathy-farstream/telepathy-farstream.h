@@ -21,6 +21,7 @@
 #define __TF_FARSTREAM_H_
 
 #include <telepathy-farstream/channel.h>
+#include <telepathy-farstream/channel-set.h>
 #include <telepathy-farstream/content.h>
 
 #endif /* __TF_FARSTREAM_H__ */
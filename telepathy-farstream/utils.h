@@ -58,5 +58,99 @@ tpdirection_to_fsdirection (TpMediaStreamDirection dir)
   }
 }
 
+/*
+ * push_thread_default_context:
+ * @context: the #GMainContext of a channel
+ *
+ * Makes @context the thread-default context, so that the async results
+ * and sources created until pop_thread_default_context() is called are
+ * dispatched in it. A channel must only be used from the thread running
+ * its context, anything else would race with the sources dispatched there,
+ * so that is a programming error if @context is owned by another thread.
+ *
+ * Return: %TRUE if @context was pushed
+ */
+
+static inline gboolean
+push_thread_default_context (GMainContext *context)
+{
+  if (context == NULL)
+    return FALSE;
+
+  if (!g_main_context_acquire (context))
+    {
+      g_critical ("A channel was used outside of the thread running its"
+          " GMainContext");
+      return FALSE;
+    }
+
+  g_main_context_push_thread_default (context);
+  g_main_context_release (context);
+
+  return TRUE;
+}
+
+static inline void
+pop_thread_default_context (GMainContext *context, gboolean pushed)
+{
+  if (pushed)
+    g_main_context_pop_thread_default (context);
+}
+
+/*
+ * attach_timeout_source:
+ * @context: the #GMainContext to attach to
+ * @interval: the timeout in milliseconds, 0 for an idle source
+ * @function: the #GSourceFunc to call
+ * @data: the data to pass to @function
+ *
+ * Return: the new #GSource, to be destroyed with g_source_destroy() and
+ *  g_source_unref()
+ */
+
+static inline GSource *
+attach_timeout_source (GMainContext *context, guint interval,
+    GSourceFunc function, gpointer data)
+{
+  GSource *source;
+
+  if (interval == 0)
+    source = g_idle_source_new ();
+  else
+    source = g_timeout_source_new (interval);
+
+  g_source_set_callback (source, function, data, NULL);
+  g_source_attach (source, context);
+
+  return source;
+}
+
+/*
+ * fscodec_params_to_tp:
+ * @fscodec: a #FsCodec
+ *
+ * Return: the optional parameters of @fscodec, in a hash table that can be
+ *  given to a #GValue of type %DBUS_TYPE_G_STRING_STRING_HASHTABLE with
+ *  g_value_take_boxed()
+ */
+
+static inline GHashTable *
+fscodec_params_to_tp (FsCodec *fscodec)
+{
+  GHashTable *params;
+  GList *item;
+
+  params = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  for (item = fscodec->optional_params; item; item = item->next)
+    {
+      FsCodecParameter *param = item->data;
+
+      g_hash_table_insert (params, g_strdup (param->name),
+          g_strdup (param->value));
+    }
+
+  return params;
+}
 
 #endif /* __UTILS_H__ */